@@ -0,0 +1,215 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2024 Franco Venturi.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+// Callback-side latency of the ring buffer between the SDRplay API stream
+// callback (producer) and work() (consumer).
+// It compares the lock-free ring buffer in lib/ring_buffer.h with the
+// previous implementation (one mutex per stream and two condition variables
+// notified on every callback), which is reproduced below as
+// 'locked_ring_buffer'.
+//
+// usage: ring_buffer_benchmark [sample rate] [samples per callback] [seconds]
+
+#include "ring_buffer.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <complex>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+using gr::sdrplay3::ring_buffer;
+using clock_type = std::chrono::steady_clock;
+
+static constexpr unsigned int RingBufferSize = 65536;
+static constexpr unsigned int RingBufferMask = RingBufferSize - 1;
+static constexpr int NOutputItems = 8192;
+
+// previous implementation
+struct locked_ring_buffer {
+    short* xi;
+    short* xq;
+    uint64_t head;
+    uint64_t tail;
+    bool aborted;
+    std::condition_variable empty;
+    std::condition_variable overflow;
+    std::mutex mtx;
+};
+
+static void copy_in(short* rxi, short* rxq, uint64_t head,
+                    const short* xi, const short* xq, unsigned int n)
+{
+    size_t start = static_cast<size_t>(head & RingBufferMask);
+    size_t end = static_cast<size_t>((head + n) & RingBufferMask);
+    if (end > start || end == 0) {
+        std::memcpy(rxi + start, xi, n * sizeof(short));
+        std::memcpy(rxq + start, xq, n * sizeof(short));
+    } else {
+        size_t first = n - end;
+        std::memcpy(rxi + start, xi, first * sizeof(short));
+        std::memcpy(rxi, xi + first, end * sizeof(short));
+        std::memcpy(rxq + start, xq, first * sizeof(short));
+        std::memcpy(rxq, xq + first, end * sizeof(short));
+    }
+}
+
+static void copy_out(const short* rxi, const short* rxq, uint64_t tail,
+                     int n, std::complex<float>* out)
+{
+    for (int i = 0; i < n; ++i) {
+        size_t k = static_cast<size_t>((tail + i) & RingBufferMask);
+        out[i] = std::complex<float>(rxi[k] / 32768.0f, rxq[k] / 32768.0f);
+    }
+}
+
+static void locked_callback(locked_ring_buffer& rb, const short* xi,
+                            const short* xq, unsigned int n)
+{
+    std::unique_lock<std::mutex> lock(rb.mtx);
+    rb.overflow.wait(lock, [&rb, n]() {
+        return rb.tail + RingBufferSize - n >= rb.head || rb.aborted;
+    });
+    copy_in(rb.xi, rb.xq, rb.head, xi, xq, n);
+    rb.head += n;
+    rb.empty.notify_one();
+}
+
+static int locked_work(locked_ring_buffer& rb, std::complex<float>* out)
+{
+    std::unique_lock<std::mutex> lock(rb.mtx);
+    rb.empty.wait(lock, [&rb]() { return rb.tail < rb.head || rb.aborted; });
+    int n = static_cast<int>(std::min<uint64_t>(rb.head - rb.tail, NOutputItems));
+    copy_out(rb.xi, rb.xq, rb.tail, n, out);
+    rb.tail += n;
+    rb.overflow.notify_one();
+    return n;
+}
+
+static void lockfree_callback(ring_buffer& rb, const short* xi,
+                              const short* xq, unsigned int n)
+{
+    if (!rb.wait_for_space(n))
+        return;
+    uint64_t head = rb.write_index();
+    copy_in(rb.xi, rb.xq, head, xi, xq, n);
+    rb.commit_write(head + n);
+}
+
+static int lockfree_work(ring_buffer& rb, std::complex<float>* out)
+{
+    uint64_t tail;
+    uint64_t nsamples = rb.wait_for_data(tail);
+    int n = static_cast<int>(std::min<uint64_t>(nsamples, NOutputItems));
+    copy_out(rb.xi, rb.xq, tail, n, out);
+    rb.commit_read(tail, tail + n);
+    return n;
+}
+
+struct result {
+    size_t callbacks;
+    double p50;
+    double p99;
+    double p999;
+    double max;
+};
+
+template <typename Callback, typename Work, typename Abort>
+static result run(double rate, unsigned int nsamples, double seconds,
+                  Callback callback, Work work, Abort abort)
+{
+    std::vector<short> xi(nsamples, 1000);
+    std::vector<short> xq(nsamples, -1000);
+    std::vector<double> latencies;
+    latencies.reserve(static_cast<size_t>(rate * seconds / nsamples) + 1);
+
+    std::atomic<bool> done(false);
+    std::thread consumer([&]() {
+        std::vector<std::complex<float>> out(NOutputItems);
+        while (!done.load())
+            work(out.data());
+    });
+
+    auto period = std::chrono::duration_cast<clock_type::duration>(
+                      std::chrono::duration<double>(nsamples / rate));
+    auto next = clock_type::now();
+    auto stop = next + std::chrono::duration_cast<clock_type::duration>(
+                           std::chrono::duration<double>(seconds));
+    while (next < stop) {
+        std::this_thread::sleep_until(next);
+        auto t0 = clock_type::now();
+        callback(xi.data(), xq.data(), nsamples);
+        auto t1 = clock_type::now();
+        latencies.push_back(std::chrono::duration<double, std::micro>(t1 - t0).count());
+        next += period;
+    }
+
+    done.store(true);
+    abort();
+    consumer.join();
+
+    std::sort(latencies.begin(), latencies.end());
+    auto percentile = [&latencies](double p) {
+        return latencies[static_cast<size_t>(p * (latencies.size() - 1))];
+    };
+    return { latencies.size(), percentile(0.5), percentile(0.99),
+             percentile(0.999), latencies.back() };
+}
+
+static void print_result(const char* name, const result& r)
+{
+    std::printf("%-20s %10zu %10.2f %10.2f %10.2f %10.2f\n", name,
+                r.callbacks, r.p50, r.p99, r.p999, r.max);
+}
+
+int main(int argc, char** argv)
+{
+    double rate = argc > 1 ? std::atof(argv[1]) : 10.66e6;
+    unsigned int nsamples = argc > 2 ? std::atoi(argv[2]) : 1008;
+    double seconds = argc > 3 ? std::atof(argv[3]) : 5.0;
+
+    std::printf("sample rate=%g samples per callback=%u duration=%gs\n",
+                rate, nsamples, seconds);
+    std::printf("callback latency (us)\n");
+    std::printf("%-20s %10s %10s %10s %10s %10s\n", "ring buffer",
+                "callbacks", "p50", "p99", "p99.9", "max");
+
+    std::vector<short> storage(2 * RingBufferSize);
+
+    locked_ring_buffer lrb;
+    lrb.xi = storage.data();
+    lrb.xq = storage.data() + RingBufferSize;
+    lrb.head = 0;
+    lrb.tail = 0;
+    lrb.aborted = false;
+    print_result("mutex+condvar",
+        run(rate, nsamples, seconds,
+            [&lrb](const short* xi, const short* xq, unsigned int n) {
+                locked_callback(lrb, xi, xq, n);
+            },
+            [&lrb](std::complex<float>* out) { return locked_work(lrb, out); },
+            [&lrb]() {
+                std::lock_guard<std::mutex> lock(lrb.mtx);
+                lrb.aborted = true;
+                lrb.empty.notify_all();
+            }));
+
+    ring_buffer rb;
+    rb.allocate(RingBufferSize, false);
+    print_result("lock-free SPSC",
+        run(rate, nsamples, seconds,
+            [&rb](const short* xi, const short* xq, unsigned int n) {
+                lockfree_callback(rb, xi, xq, n);
+            },
+            [&rb](std::complex<float>* out) { return lockfree_work(rb, out); },
+            [&rb]() { rb.abort(); }));
+
+    return 0;
+}
@@ -0,0 +1,576 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2024 Franco Venturi.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+// Benchmark suite for the sample path of gr-sdrplay3, with the results in
+// JSON format so they can be compared across releases and machines.
+//
+// sections:
+//   sample_copy  - the fc32, sc16, sc8, sc12 and fc16 copy kernels (all
+//                  the ones supported by this CPU) for several sizes, plus
+//                  the ring_buffer::read() of the converted samples at the
+//                  start and across the end of the ring
+//   ring_buffer  - producer/consumer throughput with one and two streams
+//   stream_tags  - work() time with and without stream tags while the
+//                  center frequency is changed continuously (cost of the
+//                  tag queue and of add_stream_tags())
+//   latency      - time from the stream callback to a downstream block,
+//                  measured with the rx_time tag
+// The last two run a flowgraph with an RSP1A source, i.e. they need either
+// an RSP1A or the SDRplay API stand-in (ENABLE_SDRPLAY_API_STANDIN).
+//
+// usage: sdrplay3_benchmark [--sections s1,s2,...] [--seconds s]
+//                           [--sample-rate sr] [--selector sel]
+//                           [--output file.json]
+
+#include "ring_buffer.h"
+#include "sample_copy.h"
+
+#include <gnuradio/sdrplay3/rsp1a.h>
+#include <gnuradio/io_signature.h>
+#include <gnuradio/sync_block.h>
+#include <gnuradio/top_block.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <iterator>
+#include <string>
+#include <thread>
+#include <vector>
+
+using gr::sdrplay3::ring_buffer;
+using gr::sdrplay3::sample_copy_kernels;
+using clock_type = std::chrono::steady_clock;
+
+struct options {
+    std::string sections = "sample_copy,ring_buffer,stream_tags,latency";
+    double seconds = 2.0;
+    double sample_rate = 2e6;
+    std::string selector = "";
+    std::string output = "";
+};
+
+/**********************************************************************
+ * Minimal JSON writer
+ *********************************************************************/
+class json_writer
+{
+public:
+    json_writer(FILE* out) : out(out), first(true), depth(0) {}
+
+    void begin_object(const char* key = nullptr) { open(key, '{'); }
+    void end_object() { close('}'); }
+    void begin_array(const char* key = nullptr) { open(key, '['); }
+    void end_array() { close(']'); }
+
+    void value(const char* key, double v)
+    {
+        name(key);
+        std::fprintf(out, "%.6g", v);
+    }
+    void value(const char* key, uint64_t v)
+    {
+        name(key);
+        std::fprintf(out, "%llu", static_cast<unsigned long long>(v));
+    }
+    void value(const char* key, int v) { value(key, static_cast<uint64_t>(v)); }
+    void value(const char* key, const std::string& v)
+    {
+        name(key);
+        std::fputc('"', out);
+        for (char c : v) {
+            if (c == '"' || c == '\\')
+                std::fputc('\\', out);
+            std::fputc(c, out);
+        }
+        std::fputc('"', out);
+    }
+    void value(const char* key, const char* v) { value(key, std::string(v)); }
+
+private:
+    void name(const char* key)
+    {
+        if (!first)
+            std::fputc(',', out);
+        first = false;
+        std::fprintf(out, "\n%*s", 2 * depth, "");
+        if (key)
+            std::fprintf(out, "\"%s\": ", key);
+    }
+    void open(const char* key, char c)
+    {
+        name(key);
+        std::fputc(c, out);
+        first = true;
+        depth++;
+    }
+    void close(char c)
+    {
+        depth--;
+        std::fprintf(out, "\n%*s%c", 2 * depth, "", c);
+        first = false;
+    }
+
+    FILE* out;
+    bool first;
+    int depth;
+};
+
+/**********************************************************************
+ * Sample copy kernels
+ *********************************************************************/
+static constexpr unsigned int RingBufferSize = 65536;
+
+// best time per call (in ns) of 'f' over several runs
+static double time_per_call(const std::function<void()>& f)
+{
+    // calibrate the number of iterations so each run takes about 10ms
+    int iterations = 1;
+    for (;;) {
+        auto t0 = clock_type::now();
+        for (int i = 0; i < iterations; i++)
+            f();
+        auto elapsed = clock_type::now() - t0;
+        if (elapsed > std::chrono::milliseconds(10) || iterations >= (1 << 24))
+            break;
+        iterations *= 2;
+    }
+    double best = 0;
+    for (int run = 0; run < 5; run++) {
+        auto t0 = clock_type::now();
+        for (int i = 0; i < iterations; i++)
+            f();
+        double ns = std::chrono::duration<double, std::nano>(clock_type::now() - t0).count() /
+                    iterations;
+        if (run == 0 || ns < best)
+            best = ns;
+    }
+    return best;
+}
+
+static void benchmark_sample_copy(json_writer& json)
+{
+    std::vector<short> xi(RingBufferSize);
+    std::vector<short> xq(RingBufferSize);
+    for (unsigned int i = 0; i < RingBufferSize; i++) {
+        xi[i] = static_cast<short>(i * 7);
+        xq[i] = static_cast<short>(-i * 5);
+    }
+    std::vector<std::complex<float>> out_fc32(RingBufferSize);
+    std::vector<short> out_sc16(2 * RingBufferSize);
+    std::vector<signed char> out_sc8(2 * RingBufferSize);
+    std::vector<unsigned char> out_sc12(3 * RingBufferSize);
+    std::vector<uint16_t> out_fc16(2 * RingBufferSize);
+
+    const size_t sizes[] = { 64, 336, 1008, 4096, 16384, 65536 };
+    const char* types[] = { "fc32", "sc16", "sc8", "sc12", "fc16" };
+    const size_t item_sizes[] = { sizeof(std::complex<float>), 2 * sizeof(short),
+                                  2 * sizeof(signed char), 3, 2 * sizeof(uint16_t) };
+    constexpr int NTypes = 5;
+    // position of the read in the ring: from its start, or across its end
+    // (one copy if the ring is mirrored, two otherwise)
+    const char* positions[] = { "start", "end" };
+    constexpr int NPositions = 2;
+
+    // the samples are converted once, in the stream callback, straight to
+    // the ring in the output format; work() then copies them out with
+    // ring_buffer::read(), which does not depend on the kernels
+    ring_buffer rings[NTypes];
+    for (int t = 0; t < NTypes; t++)
+        rings[t].allocate(RingBufferSize, item_sizes[t], false);
+    std::vector<char> read_out(RingBufferSize * sizeof(std::complex<float>));
+    double read_ns[NTypes][std::size(sizes)][NPositions];
+    for (int t = 0; t < NTypes; t++) {
+        for (size_t s = 0; s < std::size(sizes); s++) {
+            for (int p = 0; p < NPositions; p++) {
+                uint64_t index = p == 0 ? 0 : RingBufferSize - sizes[s] / 2;
+                unsigned int n = static_cast<unsigned int>(sizes[s]);
+                read_ns[t][s][p] = time_per_call(
+                    [&]() { rings[t].read(index, read_out.data(), n); });
+            }
+        }
+    }
+
+    json.begin_array("sample_copy");
+    for (const auto& kernels : gr::sdrplay3::get_all_sample_copy_kernels()) {
+        for (size_t s = 0; s < std::size(sizes); s++) {
+            size_t size = sizes[s];
+            double fc32_ns = time_per_call([&]() {
+                kernels.fc32(xi.data(), xq.data(), out_fc32.data(), size);
+            });
+            double sc16_ns = time_per_call([&]() {
+                kernels.sc16(xi.data(), xq.data(),
+                             reinterpret_cast<short(*)[2]>(out_sc16.data()), size);
+            });
+            double sc8_ns = time_per_call([&]() {
+                kernels.sc8(xi.data(), xq.data(),
+                            reinterpret_cast<signed char(*)[2]>(out_sc8.data()), size, 4);
+            });
+            double sc12_ns = time_per_call([&]() {
+                kernels.sc12(xi.data(), xq.data(),
+                             reinterpret_cast<unsigned char(*)[3]>(out_sc12.data()), size);
+            });
+            double fc16_ns = time_per_call([&]() {
+                kernels.fc16(xi.data(), xq.data(),
+                             reinterpret_cast<uint16_t(*)[2]>(out_fc16.data()), size);
+            });
+            const double convert_ns[] = { fc32_ns, sc16_ns, sc8_ns, sc12_ns, fc16_ns };
+            for (int t = 0; t < NTypes; t++) {
+                for (int p = 0; p < NPositions; p++) {
+                    double ns = convert_ns[t] + read_ns[t][s][p];
+                    json.begin_object();
+                    json.value("kernel", kernels.name);
+                    json.value("type", types[t]);
+                    json.value("size", static_cast<uint64_t>(size));
+                    json.value("position", positions[p]);
+                    json.value("mirrored", rings[t].is_mirrored() ? 1 : 0);
+                    json.value("convert_ns_per_call", convert_ns[t]);
+                    json.value("read_ns_per_call", read_ns[t][s][p]);
+                    json.value("ns_per_call", ns);
+                    json.value("ns_per_sample", ns / size);
+                    json.value("msamples_per_s", size / ns * 1e3);
+                    json.end_object();
+                }
+            }
+        }
+    }
+    json.end_array();
+}
+
+/**********************************************************************
+ * Ring buffer throughput
+ *********************************************************************/
+static void benchmark_ring_buffer(json_writer& json, const options& opts)
+{
+    const unsigned int packet_sizes[] = { 336, 1008 };
+    const int noutput_items = 8192;
+    auto copy = gr::sdrplay3::get_sample_copy_kernels().fc32;
+
+    json.begin_array("ring_buffer");
+    for (int nstreams = 1; nstreams <= 2; nstreams++) {
+        for (unsigned int packet_size : packet_sizes) {
+            ring_buffer rings[2];
+            for (int i = 0; i < nstreams; i++)
+                rings[i].allocate(RingBufferSize, sizeof(std::complex<float>), false);
+            std::vector<short> xi(packet_size, 1000);
+            std::vector<short> xq(packet_size, -1000);
+
+            std::atomic<bool> done(false);
+            // the producer runs like the SDRplay API thread: stream A and
+            // (in dual tuner mode) stream B, one packet at a time
+            std::thread producer([&]() {
+                while (!done.load(std::memory_order_relaxed)) {
+                    for (int i = 0; i < nstreams; i++) {
+                        if (!rings[i].wait_for_space(packet_size))
+                            return;
+                        uint64_t head = rings[i].write_index();
+                        // conversion to fc32 in the producer, like the
+                        // stream callbacks
+                        rings[i].write(head, packet_size,
+                                       [&](char* out, size_t offset, size_t count) {
+                                           copy(xi.data() + offset, xq.data() + offset,
+                                                reinterpret_cast<std::complex<float>*>(out),
+                                                count);
+                                       });
+                        rings[i].commit_write(head + packet_size);
+                    }
+                }
+            });
+
+            // the consumer does what work() does: highest stream first
+            std::vector<std::complex<float>> out[2];
+            out[0].resize(noutput_items);
+            out[1].resize(noutput_items);
+            uint64_t consumed = 0;
+            uint64_t work_calls = 0;
+            auto t0 = clock_type::now();
+            auto stop = t0 + std::chrono::duration_cast<clock_type::duration>(
+                                 std::chrono::duration<double>(opts.seconds / 4));
+            while (clock_type::now() < stop) {
+                int n = noutput_items;
+                for (int i = nstreams - 1; i >= 0; i--) {
+                    uint64_t tail;
+                    uint64_t available = rings[i].wait_for_data(tail);
+                    n = static_cast<int>(std::min<uint64_t>(available, n));
+                    rings[i].read(tail, out[i].data(), n);
+                    rings[i].commit_read(tail, tail + n);
+                }
+                consumed += n;
+                work_calls++;
+            }
+            double elapsed = std::chrono::duration<double>(clock_type::now() - t0).count();
+            done.store(true);
+            for (int i = 0; i < nstreams; i++)
+                rings[i].abort();
+            producer.join();
+
+            json.begin_object();
+            json.value("streams", nstreams);
+            json.value("packet_size", static_cast<uint64_t>(packet_size));
+            json.value("samples_per_stream", consumed);
+            json.value("msamples_per_s", consumed / elapsed * 1e-6);
+            json.value("samples_per_work", work_calls > 0 ? static_cast<double>(consumed) / work_calls : 0.0);
+            json.end_object();
+        }
+    }
+    json.end_array();
+}
+
+/**********************************************************************
+ * Flowgraph benchmarks
+ *********************************************************************/
+// sink that counts the tags and measures the latency of each work() call
+// against the rx_time tag (the sample time estimated from the arrival time
+// of the stream callbacks)
+class latency_sink : public gr::sync_block
+{
+public:
+    typedef std::shared_ptr<latency_sink> sptr;
+
+    latency_sink(double sample_rate) :
+        gr::sync_block("latency_sink",
+                       gr::io_signature::make(1, 1, sizeof(gr_complex)),
+                       gr::io_signature::make(0, 0, 0)),
+        sample_rate(sample_rate),
+        ntags(0),
+        time_valid(false)
+    {
+    }
+
+    int work(int noutput_items,
+             gr_vector_const_void_star& input_items,
+             gr_vector_void_star& output_items) override
+    {
+        uint64_t start = nitems_read(0);
+        std::vector<gr::tag_t> tags;
+        get_tags_in_range(tags, 0, start, start + noutput_items);
+        ntags += tags.size();
+        for (const auto& tag : tags) {
+            if (pmt::eq(tag.key, pmt::mp("rx_time"))) {
+                time_offset = tag.offset;
+                time_secs = static_cast<double>(pmt::to_uint64(pmt::tuple_ref(tag.value, 0))) +
+                            pmt::to_double(pmt::tuple_ref(tag.value, 1));
+                time_valid = true;
+            }
+        }
+        if (time_valid) {
+            double now = std::chrono::duration<double>(
+                std::chrono::system_clock::now().time_since_epoch()).count();
+            uint64_t last = start + noutput_items - 1;
+            double sample_time = time_secs + (last - time_offset) / sample_rate;
+            latencies.push_back((now - sample_time) * 1e6);
+        }
+        return noutput_items;
+    }
+
+    const double sample_rate;
+    uint64_t ntags;
+    std::vector<double> latencies;
+
+private:
+    bool time_valid;
+    uint64_t time_offset;
+    double time_secs;
+};
+
+static double percentile(std::vector<double> values, double p)
+{
+    if (values.empty())
+        return 0;
+    std::sort(values.begin(), values.end());
+    return values[static_cast<size_t>(p * (values.size() - 1))];
+}
+
+// upper bound (in us) of the bucket of a power of 2 histogram from get_stats()
+static double histogram_percentile(pmt::pmt_t histogram, double p)
+{
+    size_t n = pmt::length(histogram);
+    uint64_t total = 0;
+    for (size_t i = 0; i < n; i++)
+        total += pmt::u64vector_ref(histogram, i);
+    if (total == 0)
+        return 0;
+    uint64_t count = 0;
+    for (size_t i = 0; i < n; i++) {
+        count += pmt::u64vector_ref(histogram, i);
+        if (count >= p * total)
+            return static_cast<double>(1ull << i);
+    }
+    return static_cast<double>(1ull << (n - 1));
+}
+
+struct flowgraph_result {
+    uint64_t samples;
+    uint64_t tags;
+    uint64_t work_calls;
+    double work_time_p50;
+    double work_time_p99;
+    uint64_t changes;
+    std::vector<double> latencies;
+};
+
+static flowgraph_result run_flowgraph(const options& opts, bool stream_tags,
+                                      double change_interval)
+{
+    auto tb = gr::make_top_block("sdrplay3_benchmark");
+    auto source = gr::sdrplay3::rsp1a::make(opts.selector,
+                                            gr::sdrplay3::stream_args_t("fc32", 1));
+    source->set_sample_rate(opts.sample_rate);
+    source->set_center_freq(100e6);
+    source->set_gain_mode(false);
+    source->set_stream_tags(stream_tags);
+    source->set_time_tags(true);
+    auto sink = std::make_shared<latency_sink>(source->get_sample_rate());
+    tb->connect(source, 0, sink, 0);
+
+    tb->start();
+    std::atomic<bool> done(false);
+    uint64_t changes = 0;
+    std::thread changer([&]() {
+        if (change_interval <= 0)
+            return;
+        auto interval = std::chrono::duration_cast<clock_type::duration>(
+                            std::chrono::duration<double>(change_interval));
+        auto next = clock_type::now();
+        while (!done.load()) {
+            source->set_center_freq(changes % 2 == 0 ? 100.1e6 : 100e6);
+            changes++;
+            next += interval;
+            std::this_thread::sleep_until(next);
+        }
+    });
+    std::this_thread::sleep_for(std::chrono::duration<double>(opts.seconds));
+    done.store(true);
+    changer.join();
+    tb->stop();
+    tb->wait();
+
+    pmt::pmt_t stats = pmt::dict_ref(source->get_stats(), pmt::mp("stream0"), pmt::PMT_NIL);
+    pmt::pmt_t histogram = pmt::dict_ref(stats, pmt::mp("work_time_histogram"), pmt::PMT_NIL);
+    flowgraph_result result;
+    result.samples = sink->nitems_read(0);
+    result.tags = sink->ntags;
+    result.work_calls = pmt::to_uint64(pmt::dict_ref(stats, pmt::mp("work_calls"), pmt::from_uint64(0)));
+    result.work_time_p50 = histogram_percentile(histogram, 0.5);
+    result.work_time_p99 = histogram_percentile(histogram, 0.99);
+    result.changes = changes;
+    result.latencies = sink->latencies;
+    return result;
+}
+
+static void benchmark_stream_tags(json_writer& json, const options& opts)
+{
+    // (stream tags, interval between center frequency changes in s)
+    const std::pair<bool, double> cases[] = {
+        { false, 0 }, { true, 0 }, { true, 1e-2 }, { true, 1e-3 }
+    };
+
+    json.begin_array("stream_tags");
+    for (const auto& c : cases) {
+        flowgraph_result r = run_flowgraph(opts, c.first, c.second);
+        json.begin_object();
+        json.value("stream_tags", c.first ? "on" : "off");
+        json.value("changes_per_s", c.second > 0 ? 1 / c.second : 0.0);
+        json.value("changes", r.changes);
+        json.value("tags", r.tags);
+        json.value("samples", r.samples);
+        json.value("work_calls", r.work_calls);
+        json.value("work_time_p50_us", r.work_time_p50);
+        json.value("work_time_p99_us", r.work_time_p99);
+        json.end_object();
+    }
+    json.end_array();
+}
+
+static void benchmark_latency(json_writer& json, const options& opts)
+{
+    flowgraph_result r = run_flowgraph(opts, false, 0);
+    json.begin_object("latency");
+    json.value("sample_rate", opts.sample_rate);
+    json.value("work_calls", static_cast<uint64_t>(r.latencies.size()));
+    json.value("p50_us", percentile(r.latencies, 0.5));
+    json.value("p90_us", percentile(r.latencies, 0.9));
+    json.value("p99_us", percentile(r.latencies, 0.99));
+    json.value("max_us", percentile(r.latencies, 1.0));
+    json.end_object();
+}
+
+/**********************************************************************
+ * Main
+ *********************************************************************/
+static bool has_section(const options& opts, const char* section)
+{
+    std::string list = "," + opts.sections + ",";
+    return list.find("," + std::string(section) + ",") != std::string::npos;
+}
+
+int main(int argc, char** argv)
+{
+    options opts;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (i + 1 >= argc) {
+            std::fprintf(stderr, "missing value for %s\n", arg.c_str());
+            return 1;
+        }
+        if (arg == "--sections") {
+            opts.sections = argv[++i];
+        } else if (arg == "--seconds") {
+            opts.seconds = std::atof(argv[++i]);
+        } else if (arg == "--sample-rate") {
+            opts.sample_rate = std::atof(argv[++i]);
+        } else if (arg == "--selector") {
+            opts.selector = argv[++i];
+        } else if (arg == "--output") {
+            opts.output = argv[++i];
+        } else {
+            std::fprintf(stderr, "usage: %s [--sections s1,s2,...] [--seconds s] "
+                         "[--sample-rate sr] [--selector sel] [--output file.json]\n",
+                         argv[0]);
+            return 1;
+        }
+    }
+
+    FILE* out = stdout;
+    if (!opts.output.empty()) {
+        out = std::fopen(opts.output.c_str(), "w");
+        if (!out) {
+            std::perror(opts.output.c_str());
+            return 1;
+        }
+    }
+
+    json_writer json(out);
+    json.begin_object();
+    json.value("benchmark", "gr-sdrplay3");
+    json.value("timestamp", static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::seconds>(
+                                std::chrono::system_clock::now().time_since_epoch()).count()));
+    json.value("sample_copy_kernel", gr::sdrplay3::get_sample_copy_kernels().name);
+    json.value("hardware_concurrency", static_cast<uint64_t>(std::thread::hardware_concurrency()));
+    if (has_section(opts, "sample_copy"))
+        benchmark_sample_copy(json);
+    if (has_section(opts, "ring_buffer"))
+        benchmark_ring_buffer(json, opts);
+    try {
+        if (has_section(opts, "stream_tags"))
+            benchmark_stream_tags(json, opts);
+        if (has_section(opts, "latency"))
+            benchmark_latency(json, opts);
+    } catch (const std::exception& e) {
+        // no RSP (or stand-in) available
+        json.value("error", e.what());
+    }
+    json.end_object();
+    std::fprintf(out, "\n");
+
+    if (out != stdout)
+        std::fclose(out);
+    return 0;
+}
@@ -177,12 +177,114 @@ public:
     virtual void set_agc_setpoint(double set_point) = 0;
 
     /*!
-     * Add stream tags for parameter changes (sample rate, frequency, gains)
+     * Add stream tags for parameter changes (sample rate, frequency, gains) and power overloads ('overload' true/false on the first sample after the overload is detected or corrected)
      *
      * \param enable enable (or disable) stream tags for parameter changes
      */
     virtual void set_stream_tags(bool enable) = 0;
 
+    /*!
+     * Add 'rx_time' stream tags (UTC time of the sample) on the first sample and after every sample rate change or discontinuity
+     *
+     * \param enable enable (or disable) rx_time stream tags
+     */
+    virtual void set_time_tags(bool enable) = 0;
+
+    /*!
+     * Set the policy for the 'gains' stream tags (for instance with AGC enabled); the policy in use is tagged 'gain_tag_policy' on the first sample and after every change
+     *
+     * \param policy 'all' (tag every change), 'interval' (at most one tag every 'value' samples, with the latest gains), or 'threshold' (tag only LNA state changes and IF gain reduction changes of more than 'value' dB)
+     * \param value number of samples for 'interval', or dB for 'threshold'
+     */
+    virtual void set_gain_tag_policy(const std::string& policy,
+                                     const double value = 0) = 0;
+
+    /*!
+     * Get the drift of the RSP sample clock with respect to the host clock
+     *
+     * \param stream_index stream index (0 or 1)
+     * \return the drift in ppm (positive if the sample clock is fast)
+     */
+    virtual double get_clock_drift_ppm(int stream_index = 0) const = 0;
+
+    /*!
+     * Set the policy used when work() falls behind and the ring buffer is full
+     *
+     * \param policy 'block' (wait in the SDRplay API callback thread), 'drop_newest' (discard the incoming samples), or 'drop_oldest' (discard the oldest unread samples)
+     */
+    virtual void set_overflow_policy(const std::string& policy) = 0;
+
+    /*!
+     * Get the number of samples dropped because the ring buffer was full
+     *
+     * \param stream_index stream index (0 or 1)
+     * \return the number of samples dropped since the block was created
+     */
+    virtual uint64_t get_dropped_samples(int stream_index = 0) const = 0;
+
+    /*!
+     * Set the scaling of the sc8 output (tagged 'scale' every time it changes, with the factor that converts the sc8 samples back to the sc16 range)
+     *
+     * \param shift number of bits the 16 bit samples are shifted right (0-8), or -1 for automatic scaling based on the running peak of the samples
+     */
+    virtual void set_sc8_shift(int shift) = 0;
+
+    /*!
+     * Set the low water mark, i.e. how much data should be buffered before work() is woken up (0 to disable)
+     *
+     * \param low_water_mark the low water mark
+     * \param units 'samples' or 'us' (microseconds at the current sample rate)
+     */
+    virtual void set_low_water_mark(const double low_water_mark,
+                                    const std::string& units = "samples") = 0;
+
+    /*!
+     * Set the maximum time work() waits for the low water mark to be reached
+     *
+     * \param max_latency maximum latency in microseconds
+     */
+    virtual void set_max_latency(const double max_latency) = 0;
+
+    /*!
+     * Enable direct handoff: when work() is waiting for data, the stream callback converts the samples straight into its output buffer instead of the ring buffer (not used with the drop_oldest overflow policy or a low water mark)
+     *
+     * \param enable enable (or disable) direct handoff
+     */
+    virtual void set_direct_handoff(bool enable) = 0;
+
+    /*!
+     * Blank the settling transients after a retune or a gain change (gain changes made by the AGC are not blanked)
+     *
+     * \param mode 'off', 'zero' (replace the samples with zeros; the first one is tagged 'settling' with the number of samples zeroed), or 'drop' (discard the samples; the first sample after them is tagged 'settling' with the number of samples dropped)
+     * \param settling_time settling time in microseconds for all the front end bands (negative to keep the time of each band: 1000us initially, then the times set with set_band_settling_time() or measured by the calibration)
+     */
+    virtual void set_settling(const std::string& mode,
+                              const double settling_time = -1) = 0;
+
+    /*!
+     * Set the settling time for the front end band that includes a frequency
+     *
+     * \param freq any frequency in the band (Hz)
+     * \param settling_time settling time in microseconds
+     */
+    virtual void set_band_settling_time(const double freq,
+                                        const double settling_time) = 0;
+
+    /*!
+     * Get the settling time for the front end band that includes a frequency
+     *
+     * \param freq any frequency in the band (Hz)
+     * \return settling time in microseconds
+     */
+    virtual double get_band_settling_time(const double freq) const = 0;
+
+    /*!
+     * Measure the settling time after every retune or gain change (as the time until the power of the signal is stable) and use the longest one measured in each band as its settling time
+     *
+     * \param enable enable (or disable) the calibration of the settling times
+     */
+    virtual void set_settling_calibration(bool enable) = 0;
+
     /*!
      * Set debug mode for SDRplay API
      *
@@ -197,10 +299,39 @@ public:
      */
     virtual void set_sample_sequence_gaps_check(bool enable) = 0;
 
+    /*!
+     * Fill gaps in the sample sequence numbers with zero samples (tagged 'gap' with the number of missing samples; the gaps before the packets dropped by the overflow policy are not filled, and are added to the 'gap' tag of the next packet kept)
+     *
+     * \param enable enable (or disable) filling of the gaps
+     */
+    virtual void set_sample_gaps_fill(bool enable) = 0;
+
+    /*!
+     * Get the gaps found in the sample sequence numbers
+     *
+     * \param stream_index stream index (0 or 1)
+     * \return number of gaps and total number of missing samples
+     */
+    virtual std::pair<uint64_t, uint64_t> get_sample_gaps(int stream_index = 0) const = 0;
+
+    /*!
+     * Get the streaming statistics (callbacks, samples, overflows, overloads, work() calls, ring buffer fill, gaps, histograms of callback intervals and work() times)
+     *
+     * \return a dictionary with the statistics for each stream ('stream0', 'stream1')
+     */
+    virtual pmt::pmt_t get_stats() const = 0;
+
+    /*!
+     * Set how often the statistics are published on the 'status' message port
+     *
+     * \param interval interval in seconds (0 to disable)
+     */
+    virtual void set_status_interval(const double interval) = 0;
+
     /*!
      * Show gain changes (can be very noisy when AGC is enabled)
      *
-     * \param enable if enabled logs a message every time the IF gain changes (can be very noisy when AGC is enabled)
+     * \param enable if enabled logs a message every time the IF gain changes, limited by the gain tag policy (can be very noisy when AGC is enabled)
      */
     virtual void set_show_gain_changes(bool enable) = 0;
 };
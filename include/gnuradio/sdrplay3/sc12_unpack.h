@@ -0,0 +1,44 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2024 Franco Venturi.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#ifndef INCLUDED_SDRPLAY3_SC12_UNPACK_H
+#define INCLUDED_SDRPLAY3_SC12_UNPACK_H
+
+#include <gnuradio/sdrplay3/api.h>
+#include <gnuradio/sync_block.h>
+
+namespace gr {
+namespace sdrplay3 {
+
+/*! Unpack the sc12 output of the RSP source blocks
+ * \ingroup sdrplay3
+ *
+ * Each input item is a complex sample packed in 3 bytes: I and Q rounded
+ * to their 12 most significant bits, as a 24 bit little endian word (I in
+ * bits 0-11, Q in bits 12-23). The output has the same scale as the fc32 or
+ * sc16 output of the source blocks. Stream tags are passed through.
+ *
+ */
+
+class SDRPLAY3_API sc12_unpack : virtual public gr::sync_block
+{
+public:
+    // gr::sdrplay3::sc12_unpack::sptr
+    typedef std::shared_ptr<sc12_unpack> sptr;
+
+    /*!
+     * \brief Return a shared_ptr to a new instance of sdrplay3::sc12_unpack.
+     *
+     * \param output_type output type ('fc32' or 'sc16')
+     */
+    static sptr make(const std::string& output_type = "fc32");
+};
+
+} // namespace sdrplay3
+} // namespace gr
+
+#endif /* INCLUDED_SDRPLAY3_SC12_UNPACK_H */
@@ -21,12 +21,30 @@ namespace sdrplay3 {
 struct stream_args_t
 {
     stream_args_t(const std::string& output_type = "fc32",
-                  const size_t channels_size = 1) :
+                  const size_t channels_size = 1,
+                  const size_t ring_buffer_size = 65536,
+                  const bool ring_buffer_huge_pages = false,
+                  const bool split_iq = false,
+                  const size_t vector_length = 1) :
         output_type(output_type),
-        channels_size(channels_size) {
+        channels_size(channels_size),
+        ring_buffer_size(ring_buffer_size),
+        ring_buffer_huge_pages(ring_buffer_huge_pages),
+        split_iq(split_iq),
+        vector_length(vector_length) {
     }
     std::string output_type;
     size_t channels_size;
+    // ring buffer size in samples per channel (power of 2)
+    size_t ring_buffer_size;
+    // back the ring buffers with huge pages and lock them in memory
+    bool ring_buffer_huge_pages;
+    // output I and Q of each channel on two separate ports (float for fc32,
+    // int16 for sc16) instead of interleaved on a single port
+    bool split_iq;
+    // output vectors of vector_length samples per item (for instance one
+    // FFT frame), so work() always returns whole vectors
+    size_t vector_length;
 };
 
 } // namespace sdrplay3
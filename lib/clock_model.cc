@@ -0,0 +1,138 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2024 Franco Venturi.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include "clock_model.h"
+#include <cmath>
+
+namespace gr {
+namespace sdrplay3 {
+
+using std::chrono::duration;
+using std::chrono::nanoseconds;
+using std::chrono::steady_clock;
+using std::chrono::system_clock;
+
+clock_model::clock_model(double tau) :
+    tau(tau),
+    sample_rate(0),
+    valid(false),
+    sample_num0(0),
+    realtime_offset(0),
+    s0(0), sx(0), sy(0), sxx(0), sxy(0),
+    last_x(0),
+    a(0), b(1),
+    drift(0)
+{
+}
+
+void clock_model::reset(double sample_rate)
+{
+    this->sample_rate = sample_rate;
+    valid = false;
+}
+
+void clock_model::update(uint64_t sample_num, steady_clock::time_point arrival)
+{
+    if (sample_rate <= 0)
+        return;
+
+    // the realtime clock may be adjusted (NTP, PTP) at any time
+    auto steady_now = steady_clock::now();
+    auto system_now = system_clock::now();
+    realtime_offset = std::chrono::duration_cast<nanoseconds>(system_now.time_since_epoch()).count() -
+                      std::chrono::duration_cast<nanoseconds>(steady_now.time_since_epoch()).count();
+
+    if (!valid) {
+        sample_num0 = sample_num;
+        arrival0 = arrival;
+        s0 = sx = sy = sxx = sxy = 0;
+        last_x = 0;
+        a = 0;
+        b = 1;
+        valid = true;
+    }
+
+    double x = static_cast<int64_t>(sample_num - sample_num0) / sample_rate;
+    double y = duration<double>(arrival - arrival0).count();
+
+    // move the origin to the current point once in a while to keep the
+    // sums well conditioned
+    if (x > 4 * tau) {
+        uint64_t dn = sample_num - sample_num0;
+        double d = dn / sample_rate;
+        nanoseconds de = std::chrono::duration_cast<nanoseconds>(arrival - arrival0);
+        double e = duration<double>(de).count();
+        sxy = sxy - d * sy - e * sx + d * e * s0;
+        sxx = sxx - 2 * d * sx + d * d * s0;
+        sx = sx - d * s0;
+        sy = sy - e * s0;
+        a = a + b * d - e;
+        sample_num0 += dn;
+        arrival0 += de;
+        last_x -= d;
+        x -= d;
+        y -= e;
+    }
+
+    double lambda = std::exp(-(x - last_x) / tau);
+    last_x = x;
+    s0 = lambda * s0 + 1;
+    sx = lambda * sx + x;
+    sy = lambda * sy + y;
+    sxx = lambda * sxx + x * x;
+    sxy = lambda * sxy + x * y;
+
+    // the slope needs a spread of points in time; until then assume the
+    // sample rate is exact
+    double det = s0 * sxx - sx * sx;
+    if (s0 > 2 && det > 1e-6 * s0 * s0) {
+        b = (s0 * sxy - sx * sy) / det;
+    } else {
+        b = 1;
+    }
+    a = (sy - b * sx) / s0;
+    drift.store((1 / b - 1) * 1e6, std::memory_order_relaxed);
+}
+
+void clock_model::time_of(uint64_t sample_num, uint64_t& full_secs, double& frac_secs) const
+{
+    if (!valid) {
+        int64_t now = std::chrono::duration_cast<nanoseconds>(system_clock::now().time_since_epoch()).count();
+        full_secs = now / 1000000000;
+        frac_secs = (now % 1000000000) * 1e-9;
+        return;
+    }
+    double x = static_cast<int64_t>(sample_num - sample_num0) / sample_rate;
+    double y = a + b * x;
+    int64_t t0 = std::chrono::duration_cast<nanoseconds>(arrival0.time_since_epoch()).count() +
+                 realtime_offset;
+    double secs = std::floor(y);
+    int64_t full = t0 / 1000000000 + static_cast<int64_t>(secs);
+    double frac = (t0 % 1000000000) * 1e-9 + (y - secs);
+    if (frac >= 1.0) {
+        full += 1;
+        frac -= 1.0;
+    }
+    full_secs = static_cast<uint64_t>(full);
+    frac_secs = frac;
+}
+
+uint64_t clock_model::sample_num_at(uint64_t full_secs, double frac_secs) const
+{
+    if (!valid)
+        return 0;
+    int64_t t0 = std::chrono::duration_cast<nanoseconds>(arrival0.time_since_epoch()).count() +
+                 realtime_offset;
+    // keep the whole seconds apart, like time_of()
+    double y = static_cast<double>(static_cast<int64_t>(full_secs) - t0 / 1000000000) +
+               (frac_secs - (t0 % 1000000000) * 1e-9);
+    double x = (y - a) / b;
+    return sample_num0 + std::llround(x * sample_rate);
+}
+
+} // namespace sdrplay3
+} // namespace gr
@@ -0,0 +1,72 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2024 Franco Venturi.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#ifndef INCLUDED_SDRPLAY3_CLOCK_MODEL_H
+#define INCLUDED_SDRPLAY3_CLOCK_MODEL_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+namespace gr {
+namespace sdrplay3 {
+
+// Model of the RSP sample clock against the host clock.
+// Each stream callback provides a point (number of the sample following the
+// packet, arrival time of the packet on the monotonic clock); the model is
+// a least-squares line through these points, with exponential forgetting
+// (time constant 'tau') so it can follow slow drifts of the two oscillators.
+// Times are converted to the realtime clock (UTC) using the offset between
+// the realtime and the monotonic clocks at the last update, so the fit is
+// not affected by steps of the realtime clock.
+// update(), time_of() and sample_num_at() must be called from the same
+// thread (the stream callback); drift_ppm() can be called from any thread.
+class clock_model
+{
+public:
+    clock_model(double tau = 10.0);
+
+    // restart the model (for instance after a sample rate change)
+    void reset(double sample_rate);
+
+    void update(uint64_t sample_num, std::chrono::steady_clock::time_point arrival);
+
+    // UTC time of sample 'sample_num' as full seconds and fractional seconds
+    // (same format as the UHD 'rx_time' tag)
+    void time_of(uint64_t sample_num, uint64_t& full_secs, double& frac_secs) const;
+
+    // inverse of time_of(): number of the sample at UTC time full_secs +
+    // frac_secs (rounded to the nearest sample; 0 if the model is not
+    // valid yet)
+    uint64_t sample_num_at(uint64_t full_secs, double frac_secs) const;
+
+    // sample clock error with respect to the host clock in ppm (positive
+    // if the sample clock is fast)
+    double drift_ppm() const { return drift.load(std::memory_order_relaxed); }
+
+private:
+    const double tau;
+    double sample_rate;
+    bool valid;
+    // origin of the fit: sample number and arrival time of the first point
+    uint64_t sample_num0;
+    std::chrono::steady_clock::time_point arrival0;
+    // realtime - monotonic clock offset at the last update in ns
+    int64_t realtime_offset;
+    // weighted sums for the least-squares fit of y (host seconds since
+    // arrival0) vs. x (nominal seconds since sample_num0)
+    double s0, sx, sy, sxx, sxy;
+    double last_x;
+    // fitted line y = a + b * x
+    double a, b;
+    std::atomic<double> drift;
+};
+
+} // namespace sdrplay3
+} // namespace gr
+
+#endif /* INCLUDED_SDRPLAY3_CLOCK_MODEL_H */
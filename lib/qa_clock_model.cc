@@ -0,0 +1,125 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2024 Franco Venturi.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include "clock_model.h"
+#include <boost/test/unit_test.hpp>
+#include <cmath>
+#include <random>
+
+namespace gr {
+namespace sdrplay3 {
+
+using std::chrono::steady_clock;
+
+static double seconds(uint64_t full_secs, double frac_secs)
+{
+    return static_cast<double>(full_secs) + frac_secs;
+}
+
+// a sample clock 'ppm' fast, with packets of 'packet' samples arriving
+// with up to 'jitter' seconds of delay; returns the number of the next
+// sample
+static uint64_t feed(clock_model& cm, double sample_rate, double ppm,
+                     unsigned int packet, double jitter, double duration,
+                     steady_clock::time_point start, uint64_t sample_num = 0)
+{
+    std::mt19937 gen(42);
+    std::uniform_real_distribution<double> delay(0, jitter);
+    double host_rate = sample_rate * (1 + ppm * 1e-6);
+    uint64_t end = sample_num + static_cast<uint64_t>(duration * host_rate);
+    for (; sample_num < end;) {
+        sample_num += packet;
+        double t = sample_num / host_rate + delay(gen);
+        cm.update(sample_num, start + std::chrono::duration_cast<steady_clock::duration>(
+                                          std::chrono::duration<double>(t)));
+    }
+    return sample_num;
+}
+
+BOOST_AUTO_TEST_CASE(test_clock_model_invalid)
+{
+    clock_model cm;
+    // no sample rate yet: the updates are ignored and the time is the
+    // current time
+    cm.update(1000, steady_clock::now());
+    BOOST_TEST(cm.drift_ppm() == 0.0);
+    BOOST_TEST(cm.sample_num_at(1700000000, 0.5) == 0u);
+    uint64_t full_secs;
+    double frac_secs;
+    cm.time_of(1000, full_secs, frac_secs);
+    auto now = std::chrono::system_clock::now().time_since_epoch();
+    double now_secs = std::chrono::duration<double>(now).count();
+    BOOST_TEST(std::abs(seconds(full_secs, frac_secs) - now_secs) < 1.0);
+    BOOST_TEST(frac_secs >= 0.0);
+    BOOST_TEST(frac_secs < 1.0);
+
+    // a sample rate change makes the model invalid again
+    cm.reset(2e6);
+    feed(cm, 2e6, 0, 1000, 0, 1, steady_clock::now());
+    BOOST_TEST(cm.sample_num_at(full_secs, frac_secs) != 0u);
+    cm.reset(1e6);
+    BOOST_TEST(cm.sample_num_at(full_secs, frac_secs) == 0u);
+}
+
+BOOST_AUTO_TEST_CASE(test_clock_model_fit)
+{
+    const double sample_rate = 2e6;
+    const double ppm = 50;
+    clock_model cm(10.0);
+    cm.reset(sample_rate);
+    auto start = steady_clock::now();
+    uint64_t last = feed(cm, sample_rate, ppm, 100000, 200e-6, 20, start);
+    BOOST_TEST(std::abs(cm.drift_ppm() - ppm) < 2.0);
+
+    // one second worth of samples at the nominal rate takes a bit less
+    // than one second
+    uint64_t full0, full1;
+    double frac0, frac1;
+    cm.time_of(last, full0, frac0);
+    cm.time_of(last + static_cast<uint64_t>(sample_rate), full1, frac1);
+    double elapsed = seconds(full1, frac1) - seconds(full0, frac0);
+    BOOST_TEST(std::abs(elapsed - 1 / (1 + ppm * 1e-6)) < 2e-6);
+    BOOST_TEST(frac0 >= 0.0);
+    BOOST_TEST(frac0 < 1.0);
+
+    // sample_num_at() is the inverse of time_of()
+    for (uint64_t n : { last - 12345, last, last + 1000000 }) {
+        uint64_t full_secs;
+        double frac_secs;
+        cm.time_of(n, full_secs, frac_secs);
+        BOOST_TEST(cm.sample_num_at(full_secs, frac_secs) == n);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(test_clock_model_reorigin)
+{
+    // the origin of the fit moves every 4 * tau seconds; the model must
+    // not jump when it does
+    const double sample_rate = 1e6;
+    const double ppm = -20;
+    const double tau = 1.0;
+    clock_model cm(tau);
+    cm.reset(sample_rate);
+    auto start = steady_clock::now();
+    uint64_t sample_num = 0;
+    uint64_t full_secs;
+    double frac_secs;
+    double previous = 0;
+    for (int k = 0; k < 30; k++) {
+        sample_num = feed(cm, sample_rate, ppm, 10000, 0, 0.5, start, sample_num);
+        cm.time_of(sample_num, full_secs, frac_secs);
+        double t = seconds(full_secs, frac_secs);
+        if (k > 0)
+            BOOST_TEST(std::abs(t - previous - 0.5) < 1e-3);
+        previous = t;
+        BOOST_TEST(cm.sample_num_at(full_secs, frac_secs) == sample_num);
+    }
+    BOOST_TEST(std::abs(cm.drift_ppm() - ppm) < 0.5);
+}
+
+} /* namespace sdrplay3 */
+} /* namespace gr */
@@ -0,0 +1,209 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2024 Franco Venturi.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include "ring_buffer.h"
+#include <boost/test/unit_test.hpp>
+#include <thread>
+#include <vector>
+
+namespace gr {
+namespace sdrplay3 {
+
+// items are 32 bit counters, so every item read back can be checked
+static void write_counters(ring_buffer& rb, uint64_t index, unsigned int n)
+{
+    rb.write(index, n, [&rb, index](char* out, size_t offset, size_t count) {
+        for (unsigned int p = 0; p < rb.nplanes; p++) {
+            auto to = reinterpret_cast<uint32_t*>(out + p * rb.plane_stride);
+            for (size_t i = 0; i < count; i++)
+                to[i] = static_cast<uint32_t>(index + offset + i + p * 1000);
+        }
+    });
+    rb.commit_write(index + n);
+}
+
+static void check_counters(const ring_buffer& rb, uint64_t index, unsigned int n)
+{
+    std::vector<uint32_t> out(n);
+    for (unsigned int p = 0; p < rb.nplanes; p++) {
+        rb.read(index, out.data(), n, p);
+        for (unsigned int i = 0; i < n; i++)
+            BOOST_TEST(out[i] == static_cast<uint32_t>(index + i + p * 1000));
+    }
+}
+
+BOOST_AUTO_TEST_CASE(test_ring_buffer_wrap)
+{
+    for (unsigned int nplanes = 1; nplanes <= ring_buffer::MaxPlanes; nplanes++) {
+        ring_buffer rb;
+        rb.allocate(1024, sizeof(uint32_t), false, nplanes);
+        // 300 does not divide 1024, so the writes and the reads are split
+        // at the wrap-around point at different places
+        uint64_t index = 0;
+        for (int k = 0; k < 20; k++) {
+            BOOST_REQUIRE(rb.has_space(300));
+            write_counters(rb, index, 300);
+            uint64_t read_tail;
+            BOOST_REQUIRE_EQUAL(rb.wait_for_data(read_tail), 300u);
+            BOOST_REQUIRE_EQUAL(read_tail, index);
+            check_counters(rb, read_tail, 300);
+            BOOST_TEST(rb.commit_read(read_tail, read_tail + 300));
+            index += 300;
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(test_ring_buffer_space)
+{
+    ring_buffer rb;
+    rb.allocate(1024, sizeof(uint32_t), false);
+    BOOST_TEST(rb.has_space(1024));
+    BOOST_TEST(!rb.has_space(1025));
+    write_counters(rb, 0, 1000);
+    BOOST_TEST(rb.has_space(24));
+    BOOST_TEST(!rb.has_space(25));
+    BOOST_TEST(rb.commit_read(0, 100));
+    BOOST_TEST(rb.has_space(124));
+    BOOST_TEST(!rb.has_space(125));
+}
+
+BOOST_AUTO_TEST_CASE(test_ring_buffer_mirrored)
+{
+    ring_buffer rb;
+    rb.allocate(1024, sizeof(uint32_t), false, 2);
+    if (!rb.is_mirrored()) {
+        BOOST_TEST_MESSAGE("ring buffer not mirrored on this platform");
+        return;
+    }
+    // a span across the end of the ring is contiguous, and the second view
+    // shows the same memory as the first one
+    for (unsigned int p = 0; p < rb.nplanes; p++) {
+        auto span = reinterpret_cast<uint32_t*>(rb.item(1000) + p * rb.plane_stride);
+        for (uint32_t i = 0; i < 100; i++)
+            span[i] = 1000 + i + p * 1000;
+        auto start = reinterpret_cast<uint32_t*>(rb.item(1024) + p * rb.plane_stride);
+        for (uint32_t i = 0; i < 76; i++)
+            BOOST_TEST(start[i] == 1024 + i + p * 1000);
+    }
+    rb.commit_write(1100);
+    rb.commit_read(0, 1000);
+    check_counters(rb, 1000, 100);
+}
+
+BOOST_AUTO_TEST_CASE(test_ring_buffer_drop_oldest)
+{
+    ring_buffer rb;
+    rb.allocate(1024, sizeof(uint32_t), false);
+    write_counters(rb, 0, 1000);
+    // the consumer starts reading...
+    uint64_t read_tail;
+    BOOST_REQUIRE_EQUAL(rb.wait_for_data(read_tail), 1000u);
+
+    // ...while the producer makes room for 100 more
+    BOOST_TEST(rb.drop_oldest(24) == 0u);
+    BOOST_TEST(rb.drop_oldest(100) == 76u);
+    BOOST_TEST(rb.read_index() == 76u);
+    write_counters(rb, 1000, 100);
+
+    // what was read may have been overwritten, so the consumer must read
+    // again from the new tail
+    // (the consumer may not see the 100 new ones until the next call)
+    BOOST_TEST(!rb.commit_read(read_tail, read_tail + 1000));
+    uint64_t available = rb.wait_for_data(read_tail);
+    BOOST_REQUIRE_EQUAL(read_tail, 76u);
+    BOOST_REQUIRE(available >= 924u);
+    check_counters(rb, read_tail, available);
+    BOOST_TEST(rb.commit_read(read_tail, read_tail + available));
+    available = rb.wait_for_data(read_tail);
+    BOOST_REQUIRE_EQUAL(read_tail + available, 1100u);
+    check_counters(rb, read_tail, available);
+}
+
+BOOST_AUTO_TEST_CASE(test_ring_buffer_write_zeros)
+{
+    ring_buffer rb;
+    rb.allocate(1024, sizeof(uint32_t), false, 2);
+    write_counters(rb, 0, 1000);
+    rb.commit_read(0, 1000);
+    rb.write_zeros(1000, 50);
+    rb.commit_write(1050);
+    std::vector<uint32_t> out(50, 1);
+    for (unsigned int p = 0; p < rb.nplanes; p++) {
+        rb.read(1000, out.data(), 50, p);
+        for (auto v : out)
+            BOOST_TEST(v == 0u);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(test_ring_buffer_handoff)
+{
+    ring_buffer rb;
+    rb.allocate(1024, sizeof(uint32_t), false);
+    std::vector<uint32_t> out(64);
+    ring_buffer::handoff_buffer handoff;
+    handoff.out[0] = reinterpret_cast<char*>(out.data());
+    handoff.capacity = 64;
+    handoff.granularity = 16;
+    uint64_t read_tail = 0;
+    uint64_t available = 0;
+
+    // the consumer offers its buffer on the empty ring
+    std::thread consumer([&]() {
+        available = rb.wait_for_data(read_tail, 1, std::chrono::microseconds::zero(),
+                                     1, &handoff);
+    });
+
+    // the producer writes the first 48 of 50 items (a multiple of the
+    // granularity) straight to the consumer buffer, the rest to the ring
+    char* handoff_out[ring_buffer::MaxPlanes] = {};
+    unsigned int nhandoff;
+    while ((nhandoff = rb.take_handoff(0, 50, handoff_out)) == 0)
+        std::this_thread::yield();
+    BOOST_REQUIRE_EQUAL(nhandoff, 48u);
+    BOOST_REQUIRE(handoff_out[0] == handoff.out[0]);
+    auto to = reinterpret_cast<uint32_t*>(handoff_out[0]);
+    for (uint32_t i = 0; i < nhandoff; i++)
+        to[i] = i;
+    rb.complete_handoff();
+    rb.write(nhandoff, 50 - nhandoff, [](char* out, size_t offset, size_t count) {
+        auto to = reinterpret_cast<uint32_t*>(out);
+        for (size_t i = 0; i < count; i++)
+            to[i] = static_cast<uint32_t>(48 + offset + i);
+    });
+    rb.commit_write(50);
+    consumer.join();
+
+    BOOST_TEST(read_tail == 0u);
+    BOOST_TEST(available == 50u);
+    BOOST_TEST(handoff.count == 48u);
+    for (uint32_t i = 0; i < 48; i++)
+        BOOST_TEST(out[i] == i);
+    std::vector<uint32_t> rest(2);
+    rb.read(48, rest.data(), 2);
+    BOOST_TEST(rest[0] == 48u);
+    BOOST_TEST(rest[1] == 49u);
+    BOOST_TEST(rb.commit_read(read_tail, read_tail + available));
+
+    // no offer, nothing to take
+    BOOST_TEST(rb.take_handoff(50, 16, handoff_out) == 0u);
+}
+
+BOOST_AUTO_TEST_CASE(test_ring_buffer_abort)
+{
+    ring_buffer rb;
+    rb.allocate(1024, sizeof(uint32_t), false);
+    uint64_t read_tail;
+    uint64_t available = 1;
+    std::thread consumer([&]() { available = rb.wait_for_data(read_tail); });
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    rb.abort();
+    consumer.join();
+    BOOST_TEST(available == 0u);
+}
+
+} /* namespace sdrplay3 */
+} /* namespace gr */
@@ -0,0 +1,134 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2024 Franco Venturi.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+// flowgraph tests of the overflow policies, against the simulated RSP1A of
+// the SDRplay API stand-in (ENABLE_SDRPLAY_API_STANDIN)
+
+#include <gnuradio/sdrplay3/rsp1a.h>
+#include <gnuradio/io_signature.h>
+#include <gnuradio/sync_block.h>
+#include <gnuradio/top_block.h>
+#include <boost/test/unit_test.hpp>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <iterator>
+#include <map>
+#include <thread>
+#include <vector>
+
+namespace gr {
+namespace sdrplay3 {
+
+// sink that is slow while 'slow' is set (so the ring buffer of the source
+// overflows), and keeps the 'overflow' and 'rx_time' tags
+class overflow_sink : public gr::sync_block
+{
+public:
+    overflow_sink() :
+        gr::sync_block("overflow_sink",
+                       gr::io_signature::make(1, 1, sizeof(gr_complex)),
+                       gr::io_signature::make(0, 0, 0)),
+        slow(false)
+    {
+        set_max_noutput_items(4096);
+    }
+
+    int work(int noutput_items,
+             gr_vector_const_void_star& input_items,
+             gr_vector_void_star& output_items) override
+    {
+        if (slow.load())
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        uint64_t start = nitems_read(0);
+        std::vector<gr::tag_t> tags;
+        get_tags_in_range(tags, 0, start, start + noutput_items);
+        for (const auto& tag : tags) {
+            if (pmt::eq(tag.key, pmt::mp("overflow"))) {
+                overflows[tag.offset] += pmt::to_uint64(tag.value);
+            } else if (pmt::eq(tag.key, pmt::mp("rx_time"))) {
+                times[tag.offset] = static_cast<double>(pmt::to_uint64(pmt::tuple_ref(tag.value, 0))) +
+                                    pmt::to_double(pmt::tuple_ref(tag.value, 1));
+            }
+        }
+        return noutput_items;
+    }
+
+    std::atomic<bool> slow;
+    // samples dropped and time, by offset
+    std::map<uint64_t, uint64_t> overflows;
+    std::map<uint64_t, double> times;
+};
+
+static void check_overflow_tags(const std::string& policy)
+{
+    const double sample_rate = 2e6;
+    auto tb = gr::make_top_block("qa_rsp_overflow");
+    auto source = rsp1a::make("", stream_args_t("fc32", 1, 16384));
+    source->set_sample_rate(sample_rate);
+    source->set_center_freq(100e6);
+    source->set_time_tags(true);
+    source->set_overflow_policy(policy);
+    auto sink = std::make_shared<overflow_sink>();
+    tb->connect(source, 0, sink, 0);
+
+    // the sink keeps up at first (so the clock model behind the rx_time
+    // tags has settled), then reads about 400k samples/s, then catches up
+    // again (so the samples dropped last are tagged too)
+    tb->start();
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    sink->slow.store(true);
+    std::this_thread::sleep_for(std::chrono::seconds(1));
+    sink->slow.store(false);
+    std::this_thread::sleep_for(std::chrono::milliseconds(500));
+    tb->stop();
+    tb->wait();
+
+    pmt::pmt_t stats = pmt::dict_ref(source->get_stats(), pmt::mp("stream0"), pmt::PMT_NIL);
+    BOOST_REQUIRE_EQUAL(pmt::to_uint64(pmt::dict_ref(stats, pmt::mp("dropped_tags"),
+                                                     pmt::from_uint64(0))),
+                        0u);
+
+    // every sample dropped is in an overflow tag
+    uint64_t dropped = source->get_dropped_samples();
+    BOOST_TEST(dropped > 0u);
+    uint64_t tagged = 0;
+    for (const auto& overflow : sink->overflows)
+        tagged += overflow.second;
+    BOOST_TEST(tagged == dropped);
+
+    // the tags are on the first sample after the discontinuity: its time
+    // (from its sample number) is ahead of the one of the sample before by
+    // the samples dropped
+    BOOST_REQUIRE(!sink->overflows.empty());
+    for (const auto& overflow : sink->overflows) {
+        BOOST_TEST_CONTEXT(policy << " offset=" << overflow.first << " dropped=" << overflow.second)
+        {
+            auto it = sink->times.find(overflow.first);
+            BOOST_REQUIRE(it != sink->times.end());
+            BOOST_REQUIRE(it != sink->times.begin());
+            auto previous = std::prev(it);
+            double jump = (it->second - previous->second) * sample_rate -
+                          static_cast<double>(it->first - previous->first);
+            // within half a packet
+            BOOST_TEST(std::abs(jump - static_cast<double>(overflow.second)) < 500.0);
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(test_rsp_overflow_drop_newest)
+{
+    check_overflow_tags("drop_newest");
+}
+
+BOOST_AUTO_TEST_CASE(test_rsp_overflow_drop_oldest)
+{
+    check_overflow_tags("drop_oldest");
+}
+
+} /* namespace sdrplay3 */
+} /* namespace gr */
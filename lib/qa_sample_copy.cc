@@ -0,0 +1,261 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2024 Franco Venturi.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include "sample_copy.h"
+#include <boost/test/unit_test.hpp>
+#include <algorithm>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace gr {
+namespace sdrplay3 {
+
+// every SIMD kernel must give the same output as the scalar one; the
+// lengths are odd (and not multiples of the vector width) so the tails are
+// tested too, and the inputs include the extremes -32768 and 32767
+static const size_t test_lengths[] = { 0, 1, 7, 15, 17, 33, 63, 127, 1001 };
+
+static void make_input(std::vector<short>& xi, std::vector<short>& xq, size_t n)
+{
+    std::mt19937 gen(n);
+    std::uniform_int_distribution<int> dist(-32768, 32767);
+    xi.resize(n);
+    xq.resize(n);
+    for (size_t i = 0; i < n; ++i) {
+        xi[i] = static_cast<short>(dist(gen));
+        xq[i] = static_cast<short>(dist(gen));
+    }
+    if (n >= 4) {
+        xi[n / 2] = -32768;
+        xq[n / 3] = 32767;
+        xq[n - 1] = -32768;
+        xi[0] = 32767;
+    }
+}
+
+static const sample_copy_kernels& scalar_kernels()
+{
+    const sample_copy_kernels& kernels = get_all_sample_copy_kernels().front();
+    BOOST_REQUIRE_EQUAL(std::string(kernels.name), "scalar");
+    return kernels;
+}
+
+BOOST_AUTO_TEST_CASE(test_sample_copy_fc32)
+{
+    const sample_copy_kernels& scalar = scalar_kernels();
+    std::vector<short> xi, xq;
+    for (auto n : test_lengths) {
+        make_input(xi, xq, n);
+        // one extra sample so the output is not aligned to the vector width
+        std::vector<std::complex<float>> expected(n + 1), out(n + 1);
+        scalar.fc32(xi.data(), xq.data(), expected.data() + 1, n);
+        for (const auto& kernels : get_all_sample_copy_kernels()) {
+            BOOST_TEST_CONTEXT(kernels.name << " n=" << n)
+            {
+                std::fill(out.begin(), out.end(), std::complex<float>());
+                kernels.fc32(xi.data(), xq.data(), out.data() + 1, n);
+                BOOST_TEST(out == expected);
+            }
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(test_sample_copy_sc16)
+{
+    const sample_copy_kernels& scalar = scalar_kernels();
+    std::vector<short> xi, xq;
+    for (auto n : test_lengths) {
+        make_input(xi, xq, n);
+        std::vector<short> expected(2 * (n + 1)), out(2 * (n + 1));
+        auto expected_iq = reinterpret_cast<short(*)[2]>(expected.data());
+        auto out_iq = reinterpret_cast<short(*)[2]>(out.data());
+        scalar.sc16(xi.data(), xq.data(), expected_iq + 1, n);
+        for (const auto& kernels : get_all_sample_copy_kernels()) {
+            BOOST_TEST_CONTEXT(kernels.name << " n=" << n)
+            {
+                std::fill(out.begin(), out.end(), 0);
+                kernels.sc16(xi.data(), xq.data(), out_iq + 1, n);
+                BOOST_TEST(out == expected);
+            }
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(test_sample_copy_sc8)
+{
+    const sample_copy_kernels& scalar = scalar_kernels();
+    std::vector<short> xi, xq;
+    for (auto n : test_lengths) {
+        make_input(xi, xq, n);
+        for (int shift = 0; shift <= 8; ++shift) {
+            std::vector<signed char> expected(2 * n), out(2 * n);
+            auto expected_iq = reinterpret_cast<signed char(*)[2]>(expected.data());
+            auto out_iq = reinterpret_cast<signed char(*)[2]>(out.data());
+            scalar.sc8(xi.data(), xq.data(), expected_iq, n, shift);
+            for (const auto& kernels : get_all_sample_copy_kernels()) {
+                BOOST_TEST_CONTEXT(kernels.name << " n=" << n << " shift=" << shift)
+                {
+                    std::fill(out.begin(), out.end(), 0);
+                    kernels.sc8(xi.data(), xq.data(), out_iq, n, shift);
+                    BOOST_TEST(out == expected);
+                }
+            }
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(test_sample_copy_peak)
+{
+    const sample_copy_kernels& scalar = scalar_kernels();
+    std::vector<short> xi, xq;
+    for (auto n : test_lengths) {
+        make_input(xi, xq, n);
+        unsigned int expected = scalar.peak(xi.data(), xq.data(), n);
+        for (const auto& kernels : get_all_sample_copy_kernels()) {
+            BOOST_TEST_CONTEXT(kernels.name << " n=" << n)
+            {
+                BOOST_TEST(kernels.peak(xi.data(), xq.data(), n) == expected);
+            }
+        }
+    }
+
+    // -32768 only in the vector part, and only in the tail
+    for (size_t where : { size_t(3), size_t(40) }) {
+        xi.assign(41, 100);
+        xq.assign(41, -100);
+        xq[where] = -32768;
+        for (const auto& kernels : get_all_sample_copy_kernels()) {
+            BOOST_TEST_CONTEXT(kernels.name << " where=" << where)
+            {
+                BOOST_TEST(kernels.peak(xi.data(), xq.data(), 41) == 32768u);
+            }
+        }
+    }
+}
+
+// sc12 rounds to nearest and saturates at 2047; unpacked to sc16 that is
+// a multiple of 16
+static short sc12_rounded(short x)
+{
+    return static_cast<short>(std::min((x + 8) >> 4, 2047) * 16);
+}
+
+// sc12 packing, and the round trip through the sc12_unpack kernels
+BOOST_AUTO_TEST_CASE(test_sample_copy_sc12)
+{
+    const sample_copy_kernels& scalar = scalar_kernels();
+    std::vector<short> xi, xq;
+    for (auto n : test_lengths) {
+        make_input(xi, xq, n);
+        std::vector<unsigned char> expected(3 * n), out(3 * n);
+        auto expected_iq = reinterpret_cast<unsigned char(*)[3]>(expected.data());
+        auto out_iq = reinterpret_cast<unsigned char(*)[3]>(out.data());
+        scalar.sc12(xi.data(), xq.data(), expected_iq, n);
+        for (const auto& kernels : get_all_sample_copy_kernels()) {
+            BOOST_TEST_CONTEXT(kernels.name << " n=" << n)
+            {
+                std::fill(out.begin(), out.end(), 0);
+                kernels.sc12(xi.data(), xq.data(), out_iq, n);
+                BOOST_TEST(out == expected);
+
+                // unpacking gives back the rounded values
+                std::vector<short> sc16(2 * n);
+                auto sc16_iq = reinterpret_cast<short(*)[2]>(sc16.data());
+                kernels.sc12_to_sc16(out_iq, sc16_iq, n);
+                for (size_t i = 0; i < n; ++i) {
+                    BOOST_TEST(sc16[2 * i] == sc12_rounded(xi[i]));
+                    BOOST_TEST(sc16[2 * i + 1] == sc12_rounded(xq[i]));
+                }
+
+                // and as complex float, the same as fc32 of those values
+                std::vector<short> ti(n), tq(n);
+                for (size_t i = 0; i < n; ++i) {
+                    ti[i] = sc12_rounded(xi[i]);
+                    tq[i] = sc12_rounded(xq[i]);
+                }
+                std::vector<std::complex<float>> fc32(n), fc32_expected(n);
+                scalar.fc32(ti.data(), tq.data(), fc32_expected.data(), n);
+                kernels.sc12_to_fc32(out_iq, fc32.data(), n);
+                BOOST_TEST(fc32 == fc32_expected);
+            }
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(test_sample_copy_sc12_rounding)
+{
+    // the halfway points round up, and the ones that would round to 2048
+    // saturate; 24 samples, so both the vector part and the tail see them
+    const std::vector<short> values = { 0, 7, 8, 9, -7, -8, -9, 23, 24, -24, -25,
+                                        32759, 32760, 32767, -32760, -32761, -32768 };
+    const std::vector<short> expected = { 0, 0, 16, 16, 0, 0, -16, 16, 32, -16, -32,
+                                          32752, 32752, 32752, -32752, -32768, -32768 };
+    std::vector<short> xi(24), xq(24);
+    for (size_t i = 0; i < xi.size(); ++i) {
+        xi[i] = values[i % values.size()];
+        xq[i] = values[(i + 5) % values.size()];
+    }
+    std::vector<unsigned char> out(3 * xi.size());
+    std::vector<short> sc16(2 * xi.size());
+    auto out_iq = reinterpret_cast<unsigned char(*)[3]>(out.data());
+    auto sc16_iq = reinterpret_cast<short(*)[2]>(sc16.data());
+    for (const auto& kernels : get_all_sample_copy_kernels()) {
+        BOOST_TEST_CONTEXT(kernels.name)
+        {
+            kernels.sc12(xi.data(), xq.data(), out_iq, xi.size());
+            kernels.sc12_to_sc16(out_iq, sc16_iq, xi.size());
+            for (size_t i = 0; i < xi.size(); ++i) {
+                BOOST_TEST(sc16[2 * i] == expected[i % values.size()]);
+                BOOST_TEST(sc16[2 * i + 1] == expected[(i + 5) % values.size()]);
+            }
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(test_sample_copy_fc16)
+{
+    const sample_copy_kernels& scalar = scalar_kernels();
+    std::vector<short> xi, xq;
+    for (auto n : test_lengths) {
+        make_input(xi, xq, n);
+        std::vector<uint16_t> expected(2 * n), out(2 * n);
+        auto expected_iq = reinterpret_cast<uint16_t(*)[2]>(expected.data());
+        auto out_iq = reinterpret_cast<uint16_t(*)[2]>(out.data());
+        scalar.fc16(xi.data(), xq.data(), expected_iq, n);
+        for (const auto& kernels : get_all_sample_copy_kernels()) {
+            BOOST_TEST_CONTEXT(kernels.name << " n=" << n)
+            {
+                std::fill(out.begin(), out.end(), 0);
+                kernels.fc16(xi.data(), xq.data(), out_iq, n);
+                BOOST_TEST(out == expected);
+            }
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(test_sample_copy_f32)
+{
+    const sample_copy_kernels& scalar = scalar_kernels();
+    std::vector<short> xi, xq;
+    for (auto n : test_lengths) {
+        make_input(xi, xq, n);
+        std::vector<float> expected(n + 1), out(n + 1);
+        scalar.f32(xi.data(), expected.data() + 1, n);
+        for (const auto& kernels : get_all_sample_copy_kernels()) {
+            BOOST_TEST_CONTEXT(kernels.name << " n=" << n)
+            {
+                std::fill(out.begin(), out.end(), 0.0f);
+                kernels.f32(xi.data(), out.data() + 1, n);
+                BOOST_TEST(out == expected);
+            }
+        }
+    }
+}
+
+} /* namespace sdrplay3 */
+} /* namespace gr */
@@ -0,0 +1,86 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2024 Franco Venturi.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include "spsc_queue.h"
+#include <boost/test/unit_test.hpp>
+#include <thread>
+
+namespace gr {
+namespace sdrplay3 {
+
+BOOST_AUTO_TEST_CASE(test_spsc_queue_full_empty)
+{
+    spsc_queue<int> q;
+    q.allocate(8);
+    BOOST_TEST(q.capacity() == 8u);
+
+    int n = 0;
+    q.drain([&n](const int&) { n++; return true; });
+    BOOST_TEST(n == 0);
+
+    for (int i = 0; i < 8; i++)
+        BOOST_TEST(q.push(i));
+    BOOST_TEST(!q.push(8));
+
+    // take only the first 3; the others stay in the queue
+    std::vector<int> taken;
+    q.drain([&taken](const int& item) {
+        if (taken.size() == 3)
+            return false;
+        taken.push_back(item);
+        return true;
+    });
+    BOOST_TEST(taken == std::vector<int>({ 0, 1, 2 }));
+
+    // there is room for 3 more, which wrap around
+    for (int i = 8; i < 11; i++)
+        BOOST_TEST(q.push(i));
+    BOOST_TEST(!q.push(11));
+
+    taken.clear();
+    q.drain([&taken](const int& item) { taken.push_back(item); return true; });
+    BOOST_TEST(taken == std::vector<int>({ 3, 4, 5, 6, 7, 8, 9, 10 }));
+
+    taken.clear();
+    q.drain([&taken](const int& item) { taken.push_back(item); return true; });
+    BOOST_TEST(taken.empty());
+    BOOST_TEST(q.push(11));
+
+    // reset() empties the queue
+    q.allocate(8);
+    q.drain([&n](const int&) { n++; return true; });
+    BOOST_TEST(n == 0);
+}
+
+BOOST_AUTO_TEST_CASE(test_spsc_queue_threads)
+{
+    // every item arrives once and in order
+    constexpr uint64_t N = 200000;
+    spsc_queue<uint64_t> q;
+    q.allocate(64);
+    std::thread producer([&q]() {
+        for (uint64_t i = 0; i < N; i++) {
+            while (!q.push(i))
+                std::this_thread::yield();
+        }
+    });
+    uint64_t next = 0;
+    bool in_order = true;
+    while (next < N) {
+        q.drain([&next, &in_order](const uint64_t& item) {
+            in_order = in_order && item == next;
+            next++;
+            return true;
+        });
+    }
+    producer.join();
+    BOOST_TEST(in_order);
+    BOOST_TEST(next == N);
+}
+
+} /* namespace sdrplay3 */
+} /* namespace gr */
@@ -0,0 +1,202 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2024 Franco Venturi.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include "ring_buffer.h"
+#include <cstring>
+#include <new>
+
+#ifdef _WIN32
+#include <malloc.h>
+#else
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#if defined(__linux__) && defined(MFD_CLOEXEC)
+#define SDRPLAY3_RING_BUFFER_MIRRORED
+#endif
+
+namespace gr {
+namespace sdrplay3 {
+
+constexpr static size_t HugePageSize = 2 * 1024 * 1024;
+
+#ifdef SDRPLAY3_RING_BUFFER_MIRRORED
+// Map each of the nplanes planes of 'bytes' bytes of a memory file twice
+// back to back (so the item at size + k is the item at k), like the
+// vmcircbuf buffers in gnuradio.
+// Returns the address of the 2 * bytes * nplanes region, or MAP_FAILED
+static void* map_mirrored(size_t bytes, unsigned int nplanes, bool hugetlb)
+{
+    unsigned int flags = MFD_CLOEXEC;
+    size_t alignment = 0;
+    if (hugetlb) {
+#ifdef MFD_HUGETLB
+        if (bytes % HugePageSize != 0)
+            return MAP_FAILED;
+        flags |= MFD_HUGETLB;
+        alignment = HugePageSize;
+#else
+        return MAP_FAILED;
+#endif
+    }
+    int fd = memfd_create("sdrplay3_ring_buffer", flags);
+    if (fd < 0)
+        return MAP_FAILED;
+    if (ftruncate(fd, bytes * nplanes) != 0) {
+        close(fd);
+        return MAP_FAILED;
+    }
+
+    // reserve the address space (aligned for huge pages if needed) and
+    // map the file over it
+    size_t mirrored_bytes = 2 * bytes * nplanes;
+    char* reserved = static_cast<char*>(mmap(nullptr, mirrored_bytes + alignment, PROT_NONE,
+                                             MAP_PRIVATE | MAP_ANONYMOUS, -1, 0));
+    if (reserved == MAP_FAILED) {
+        close(fd);
+        return MAP_FAILED;
+    }
+    char* p = reserved;
+    if (alignment > 0) {
+        p = reinterpret_cast<char*>(
+            (reinterpret_cast<uintptr_t>(reserved) + alignment - 1) & ~(alignment - 1));
+        if (p > reserved)
+            munmap(reserved, p - reserved);
+        if (reserved + alignment > p)
+            munmap(p + mirrored_bytes, reserved + alignment - p);
+    }
+    bool ok = true;
+    for (unsigned int i = 0; i < 2 * nplanes && ok; i++) {
+        ok = mmap(p + i * bytes, bytes, PROT_READ | PROT_WRITE,
+                  MAP_SHARED | MAP_FIXED, fd, (i / 2) * bytes) != MAP_FAILED;
+    }
+    close(fd);
+    if (!ok) {
+        munmap(p, mirrored_bytes);
+        return MAP_FAILED;
+    }
+    return p;
+}
+#endif
+
+void ring_buffer::allocate(unsigned int new_size, size_t new_item_size,
+                           bool huge_pages, unsigned int new_nplanes)
+{
+    // keep the current buffers if nothing changed
+    if (storage != nullptr && new_size == size && new_item_size == item_size &&
+        new_nplanes == nplanes && huge_pages == storage_huge_pages_requested) {
+        reset();
+        return;
+    }
+    release();
+
+    size_t plane_bytes = new_item_size * new_size;
+    size_t stride = plane_bytes;
+    size_t bytes = plane_bytes * new_nplanes;
+    bool use_huge_pages = false;
+    bool locked = false;
+    bool mirrored = false;
+#ifdef _WIN32
+    // large pages on Windows require the 'Lock pages in memory' privilege;
+    // just use a cache line aligned allocation
+    void* p = _aligned_malloc(bytes, 64);
+    if (p == nullptr)
+        throw std::bad_alloc();
+#else
+    void* p = MAP_FAILED;
+#ifdef SDRPLAY3_RING_BUFFER_MIRRORED
+    // explicit huge pages if possible, otherwise regular shared memory
+    // (which can use transparent huge pages too, depending on
+    // /sys/kernel/mm/transparent_hugepage/shmem_enabled)
+    if (huge_pages) {
+        p = map_mirrored(plane_bytes, new_nplanes, true);
+        use_huge_pages = p != MAP_FAILED;
+    }
+    if (p == MAP_FAILED)
+        p = map_mirrored(plane_bytes, new_nplanes, false);
+    if (p != MAP_FAILED) {
+        bytes *= 2;
+        stride *= 2;
+        mirrored = true;
+#ifdef MADV_HUGEPAGE
+        if (huge_pages && !use_huge_pages && bytes >= HugePageSize)
+            use_huge_pages = madvise(p, bytes, MADV_HUGEPAGE) == 0;
+#endif
+    }
+#endif
+#ifdef MAP_HUGETLB
+    if (p == MAP_FAILED && huge_pages) {
+        // explicit huge pages (from the hugetlbfs pool)
+        size_t huge_bytes = (bytes + HugePageSize - 1) & ~(HugePageSize - 1);
+        p = mmap(nullptr, huge_bytes, PROT_READ | PROT_WRITE,
+                 MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (p != MAP_FAILED) {
+            bytes = huge_bytes;
+            use_huge_pages = true;
+        }
+    }
+#endif
+    if (p == MAP_FAILED) {
+        p = mmap(nullptr, bytes, PROT_READ | PROT_WRITE,
+                 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (p == MAP_FAILED)
+            throw std::bad_alloc();
+#ifdef MADV_HUGEPAGE
+        // fall back to transparent huge pages
+        if (huge_pages && bytes >= HugePageSize)
+            use_huge_pages = madvise(p, bytes, MADV_HUGEPAGE) == 0;
+#endif
+    }
+    if (huge_pages)
+        locked = mlock(p, bytes) == 0;
+#endif
+    // touch every page now instead of in the stream callback (both views
+    // of the mirrored ring, to set up their page tables as well)
+    std::memset(p, 0, bytes);
+
+    storage = p;
+    storage_bytes = bytes;
+    storage_huge_pages_requested = huge_pages;
+    storage_huge_pages = use_huge_pages;
+    storage_locked = locked;
+    storage_mirrored = mirrored;
+    items = static_cast<char*>(p);
+    item_size = new_item_size;
+    size = new_size;
+    mask = new_size - 1;
+    nplanes = new_nplanes;
+    plane_stride = stride;
+    reset();
+}
+
+void ring_buffer::release()
+{
+    if (storage == nullptr)
+        return;
+#ifdef _WIN32
+    _aligned_free(storage);
+#else
+    if (storage_locked)
+        munlock(storage, storage_bytes);
+    munmap(storage, storage_bytes);
+#endif
+    storage = nullptr;
+    storage_bytes = 0;
+    storage_huge_pages = false;
+    storage_locked = false;
+    storage_mirrored = false;
+    items = nullptr;
+    item_size = 0;
+    size = 0;
+    mask = 0;
+    nplanes = 0;
+    plane_stride = 0;
+}
+
+} // namespace sdrplay3
+} // namespace gr
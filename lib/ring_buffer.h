@@ -0,0 +1,425 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2024 Franco Venturi.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#ifndef INCLUDED_SDRPLAY3_RING_BUFFER_H
+#define INCLUDED_SDRPLAY3_RING_BUFFER_H
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+#include <thread>
+
+namespace gr {
+namespace sdrplay3 {
+
+// Single producer (stream callback) / single consumer (work()) ring buffer
+// for the samples, stored as fixed size items in the output format of the
+// block (interleaved complex int16 or complex float), so the producer does
+// the conversion and the consumer only copies them out.
+// head and tail are free running sample counters; head is only written by
+// the producer and tail only by the consumer, so neither side needs a lock
+// to move data. They are kept on separate cache lines to avoid false sharing.
+// The mutex and the condition variables are only used to put a thread to
+// sleep when the ring is truly empty (consumer) or full (producer); the
+// other side takes the mutex only if it sees that somebody is asleep.
+// A sleeping consumer can ask to be woken up only once a minimum number of
+// samples is available (low water mark), to batch the work() calls.
+// The items are kept in a single allocation which is reused across
+// start/stop cycles and optionally backed by huge pages and locked in RAM.
+// Where possible (Linux) the allocation is mapped twice back to back, so any
+// span of up to 'size' items starting anywhere in the ring is contiguous
+// and never needs to be split at the wrap-around point.
+// The items can also be split in several planes sharing the same indexes
+// (for instance the I and Q values of the split I/Q output); plane p of
+// the item at item(index) is at item(index) + p * plane_stride.
+// Direct handoff: a consumer about to sleep on an empty ring can offer its
+// own output buffer; the producer then writes the next items straight
+// there (and only the leftovers to the ring), saving a copy. The items
+// handed off still take up their indexes in the ring, they are just never
+// written to it, so this must not be combined with drop_oldest().
+class ring_buffer
+{
+public:
+    constexpr static unsigned int MaxPlanes = 2;
+
+    // output buffer offered by the consumer for a direct handoff
+    struct handoff_buffer {
+        char* out[MaxPlanes];           // one pointer per plane
+        unsigned int capacity;          // in items
+        unsigned int granularity;       // hand off a multiple of this
+        unsigned int count;             // items written by the producer
+    };
+
+    ring_buffer() :
+        items(nullptr),
+        item_size(0),
+        size(0),
+        mask(0),
+        nplanes(0),
+        plane_stride(0),
+        storage(nullptr),
+        storage_bytes(0),
+        storage_huge_pages_requested(false),
+        storage_huge_pages(false),
+        storage_locked(false),
+        storage_mirrored(false),
+        head(0),
+        cached_tail(0),
+        tail(0),
+        cached_head(0),
+        producer_waiting(false),
+        consumer_waiting(false),
+        wake_threshold(1),
+        aborted(false),
+        handoff_state(handoff_idle),
+        handoff_offer(nullptr),
+        handoff_index(0),
+        handoff_count(0)
+    {
+    }
+
+    ~ring_buffer() { release(); }
+
+    ring_buffer(const ring_buffer&) = delete;
+    void operator=(const ring_buffer&) = delete;
+
+    char* items;
+    size_t item_size;
+    unsigned int size;
+    unsigned int mask;
+    unsigned int nplanes;
+    size_t plane_stride;
+
+    // (re)allocate the ring for size items of item_size bytes in each of
+    // nplanes planes; size must be a power of 2 to simplify wrap-around.
+    // If huge_pages is set, try to back the ring with 2MB huge pages and to
+    // lock it in memory; both are best effort - see has_huge_pages() and
+    // is_locked(). The memory is touched here, so there are no page faults
+    // once streaming starts.
+    // Must not be called while streaming; throws std::bad_alloc on failure
+    void allocate(unsigned int size, size_t item_size, bool huge_pages,
+                  unsigned int nplanes = 1);
+    void release();
+    bool has_huge_pages() const { return storage_huge_pages; }
+    bool is_locked() const { return storage_locked; }
+    // the items from item(index) to item(index + size - 1) are contiguous
+    bool is_mirrored() const { return storage_mirrored; }
+
+    char* item(uint64_t index) const
+    {
+        return items + static_cast<size_t>(index & mask) * item_size;
+    }
+
+    void reset()
+    {
+        head.store(0, std::memory_order_relaxed);
+        cached_tail = 0;
+        tail.store(0, std::memory_order_relaxed);
+        cached_head = 0;
+        wake_threshold.store(1, std::memory_order_relaxed);
+        handoff_state.store(handoff_idle, std::memory_order_relaxed);
+        aborted.store(false, std::memory_order_seq_cst);
+    }
+
+    // wake up both sides and make them return right away
+    void abort()
+    {
+        aborted.store(true, std::memory_order_seq_cst);
+        std::lock_guard<std::mutex> lock(mtx);
+        empty.notify_all();
+        overflow.notify_all();
+    }
+
+    /**********************************************************************
+     * Producer side
+     *********************************************************************/
+    uint64_t write_index() const
+    {
+        return head.load(std::memory_order_relaxed);
+    }
+
+    // returns false if the ring buffer has been aborted while waiting
+    bool wait_for_space(unsigned int nsamples)
+    {
+        if (has_space(nsamples))
+            return true;
+
+        uint64_t h = head.load(std::memory_order_relaxed);
+        std::unique_lock<std::mutex> lock(mtx);
+        producer_waiting.store(true, std::memory_order_seq_cst);
+        overflow.wait(lock, [this, h, nsamples]() {
+            cached_tail = tail.load(std::memory_order_seq_cst);
+            return h + nsamples - cached_tail <= size ||
+                   aborted.load(std::memory_order_relaxed);
+        });
+        producer_waiting.store(false, std::memory_order_relaxed);
+        return !aborted.load(std::memory_order_relaxed);
+    }
+
+    // non blocking check for room for nsamples
+    bool has_space(unsigned int nsamples)
+    {
+        uint64_t h = head.load(std::memory_order_relaxed);
+        if (h + nsamples - cached_tail <= size)
+            return true;
+        cached_tail = tail.load(std::memory_order_acquire);
+        return h + nsamples - cached_tail <= size;
+    }
+
+    // make room for nsamples by discarding the oldest unread samples;
+    // returns the number of samples discarded
+    // (the consumer notices it in commit_read() and reads again)
+    uint64_t drop_oldest(unsigned int nsamples)
+    {
+        uint64_t h = head.load(std::memory_order_relaxed);
+        uint64_t t = tail.load(std::memory_order_acquire);
+        while (h + nsamples - t > size) {
+            uint64_t new_tail = h + nsamples - size;
+            if (tail.compare_exchange_weak(t, new_tail,
+                                           std::memory_order_acq_rel,
+                                           std::memory_order_acquire)) {
+                cached_tail = new_tail;
+                return new_tail - t;
+            }
+        }
+        cached_tail = t;
+        return 0;
+    }
+
+    // write nsamples items starting at index; fill(out, offset, count) must
+    // store the input samples [offset, offset + count) at out (and in the
+    // other planes, if any). It is called once, or twice if the write has to
+    // be split at the wrap-around point
+    template <typename Fill>
+    void write(uint64_t index, unsigned int nsamples, Fill fill)
+    {
+        size_t first = contiguous(index, nsamples);
+        fill(item(index), 0, first);
+        if (first < nsamples)
+            fill(items, first, nsamples - first);
+    }
+
+    // take the buffer offered by a waiting consumer, if it is for the items
+    // starting at index; returns the number of items (at most nsamples) to
+    // write to out (one pointer per plane), or 0 if there is no offer.
+    // After writing them, call complete_handoff() before commit_write()
+    unsigned int take_handoff(uint64_t index, unsigned int nsamples, char** out)
+    {
+        if (handoff_state.load(std::memory_order_relaxed) != handoff_offered)
+            return 0;
+        int expected = handoff_offered;
+        if (!handoff_state.compare_exchange_strong(expected, handoff_taken,
+                                                   std::memory_order_acquire))
+            return 0;
+        const handoff_buffer* offer = handoff_offer;
+        unsigned int n = std::min(nsamples, offer->capacity);
+        n -= n % offer->granularity;
+        if (index != handoff_index)
+            n = 0;
+        handoff_count = n;
+        if (n == 0) {
+            // the offer is used up anyway (the consumer may be withdrawing
+            // it right now)
+            complete_handoff();
+            return 0;
+        }
+        for (unsigned int p = 0; p < nplanes; p++)
+            out[p] = offer->out[p];
+        return n;
+    }
+
+    void complete_handoff()
+    {
+        handoff_state.store(handoff_done, std::memory_order_release);
+    }
+
+    // set nsamples items starting at index to zero
+    void write_zeros(uint64_t index, unsigned int nsamples)
+    {
+        write(index, nsamples, [this](char* out, size_t, size_t count) {
+            for (unsigned int p = 0; p < nplanes; p++)
+                std::memset(out + p * plane_stride, 0, count * item_size);
+        });
+    }
+
+    // publish the samples written up to new_head
+    void commit_write(uint64_t new_head)
+    {
+        head.store(new_head, std::memory_order_seq_cst);
+        if (consumer_waiting.load(std::memory_order_seq_cst) &&
+            new_head - tail.load(std::memory_order_relaxed) >=
+                wake_threshold.load(std::memory_order_seq_cst)) {
+            std::lock_guard<std::mutex> lock(mtx);
+            empty.notify_one();
+        }
+    }
+
+    /**********************************************************************
+     * Consumer side
+     *********************************************************************/
+    uint64_t read_index() const
+    {
+        return tail.load(std::memory_order_relaxed);
+    }
+
+    // returns the number of samples available to read starting at
+    // read_tail (0 if aborted)
+    // If min_samples > min_required, wait until at least min_samples are
+    // available or max_wait has elapsed, whichever comes first; after that
+    // return as soon as there are min_required samples (which must not be
+    // more than size)
+    // If handoff is set and the ring is empty, it is offered to the
+    // producer while waiting (only when min_samples <= min_required); on
+    // return handoff->count is the number of items starting at read_tail
+    // that are already in handoff->out
+    uint64_t wait_for_data(uint64_t& read_tail, uint64_t min_samples = 1,
+                           std::chrono::microseconds max_wait =
+                               std::chrono::microseconds::zero(),
+                           uint64_t min_required = 1,
+                           handoff_buffer* handoff = nullptr)
+    {
+        if (handoff != nullptr)
+            handoff->count = 0;
+        // the tail can only be moved ahead by drop_oldest() in the producer
+        read_tail = tail.load(std::memory_order_acquire);
+        if (cached_head >= read_tail + min_samples)
+            return cached_head - read_tail;
+        cached_head = head.load(std::memory_order_acquire);
+        if (cached_head >= read_tail + min_samples)
+            return cached_head - read_tail;
+
+        std::unique_lock<std::mutex> lock(mtx);
+        if (min_samples > min_required) {
+            wake_threshold.store(min_samples, std::memory_order_seq_cst);
+            consumer_waiting.store(true, std::memory_order_seq_cst);
+            empty.wait_for(lock, max_wait, [this, &read_tail, min_samples]() {
+                read_tail = tail.load(std::memory_order_seq_cst);
+                cached_head = head.load(std::memory_order_seq_cst);
+                return cached_head >= read_tail + min_samples ||
+                       aborted.load(std::memory_order_relaxed);
+            });
+        }
+        wake_threshold.store(min_required, std::memory_order_seq_cst);
+        consumer_waiting.store(true, std::memory_order_seq_cst);
+        bool offered = false;
+        if (handoff != nullptr && min_samples <= min_required) {
+            read_tail = tail.load(std::memory_order_seq_cst);
+            cached_head = head.load(std::memory_order_seq_cst);
+            if (cached_head == read_tail) {
+                handoff_offer = handoff;
+                handoff_index = read_tail;
+                handoff_state.store(handoff_offered, std::memory_order_seq_cst);
+                offered = true;
+            }
+        }
+        empty.wait(lock, [this, &read_tail, min_required]() {
+            read_tail = tail.load(std::memory_order_seq_cst);
+            cached_head = head.load(std::memory_order_seq_cst);
+            return cached_head >= read_tail + min_required ||
+                   aborted.load(std::memory_order_relaxed);
+        });
+        consumer_waiting.store(false, std::memory_order_relaxed);
+        wake_threshold.store(1, std::memory_order_seq_cst);
+        lock.unlock();
+        if (offered)
+            handoff->count = withdraw_handoff();
+        return cached_head >= read_tail + min_required ? cached_head - read_tail : 0;
+    }
+
+    // copy nsamples items of the given plane starting at index to out
+    void read(uint64_t index, void* out, unsigned int nsamples,
+              unsigned int plane = 0) const
+    {
+        size_t first = contiguous(index, nsamples);
+        size_t offset = plane * plane_stride;
+        std::memcpy(out, item(index) + offset, first * item_size);
+        if (first < nsamples)
+            std::memcpy(static_cast<char*>(out) + first * item_size, items + offset,
+                        (nsamples - first) * item_size);
+    }
+
+    // release the samples read from read_tail up to new_tail; returns false
+    // if the producer dropped some of them in the meantime (i.e. what was
+    // read may have been overwritten and must be read again)
+    bool commit_read(uint64_t read_tail, uint64_t new_tail)
+    {
+        bool ok = tail.compare_exchange_strong(read_tail, new_tail,
+                                               std::memory_order_seq_cst);
+        if (producer_waiting.load(std::memory_order_seq_cst)) {
+            std::lock_guard<std::mutex> lock(mtx);
+            overflow.notify_one();
+        }
+        return ok;
+    }
+
+private:
+    // take back the buffer offered to the producer; returns the number of
+    // items the producer wrote to it
+    unsigned int withdraw_handoff()
+    {
+        int expected = handoff_offered;
+        if (handoff_state.compare_exchange_strong(expected, handoff_idle,
+                                                  std::memory_order_acquire))
+            return 0;
+        // the producer took it; it completes the handoff before publishing
+        // the new head, so this only spins if we were woken up by abort()
+        while (handoff_state.load(std::memory_order_acquire) != handoff_done)
+            std::this_thread::yield();
+        handoff_state.store(handoff_idle, std::memory_order_relaxed);
+        return handoff_count;
+    }
+
+    // number of items that can be accessed linearly from index
+    size_t contiguous(uint64_t index, unsigned int nsamples) const
+    {
+        if (storage_mirrored)
+            return nsamples;
+        size_t start = static_cast<size_t>(index & mask);
+        return std::min<size_t>(nsamples, size - start);
+    }
+
+    void* storage;
+    size_t storage_bytes;
+    bool storage_huge_pages_requested;
+    bool storage_huge_pages;
+    bool storage_locked;
+    bool storage_mirrored;
+
+    // producer cache line
+    alignas(64) std::atomic<uint64_t> head;
+    uint64_t cached_tail;
+
+    // consumer cache line
+    alignas(64) std::atomic<uint64_t> tail;
+    uint64_t cached_head;
+
+    // slow path (sleep/wake up)
+    alignas(64) std::atomic<bool> producer_waiting;
+    std::atomic<bool> consumer_waiting;
+    std::atomic<uint64_t> wake_threshold;
+    std::atomic<bool> aborted;
+    std::mutex mtx;
+    std::condition_variable empty;
+    std::condition_variable overflow;
+
+    // direct handoff
+    enum { handoff_idle, handoff_offered, handoff_taken, handoff_done };
+    alignas(64) std::atomic<int> handoff_state;
+    handoff_buffer* handoff_offer;
+    uint64_t handoff_index;
+    unsigned int handoff_count;
+};
+
+} // namespace sdrplay3
+} // namespace gr
+
+#endif /* INCLUDED_SDRPLAY3_RING_BUFFER_H */
@@ -10,7 +10,10 @@
 #endif
 
 #include <gnuradio/io_signature.h>
+#include <cmath>
+#include <cstring>
 #include "rsp_impl.h"
+#include "sample_copy.h"
 #include "sdrplay_api.h"
 
 namespace gr {
@@ -25,10 +28,30 @@ static constexpr double SDRPLAY_FREQ_MAX = 2000e6;
 static const pmt::pmt_t RATE_KEY = pmt::string_to_symbol("rate");
 static const pmt::pmt_t FREQ_KEY = pmt::string_to_symbol("freq");
 static const pmt::pmt_t GAINS_KEY = pmt::string_to_symbol("gains");
+static const pmt::pmt_t OVERFLOW_KEY = pmt::string_to_symbol("overflow");
+static const pmt::pmt_t TIME_KEY = pmt::string_to_symbol("rx_time");
+static const pmt::pmt_t GAP_KEY = pmt::string_to_symbol("gap");
+static const pmt::pmt_t SCALE_KEY = pmt::string_to_symbol("scale");
+static const pmt::pmt_t GAIN_TAG_POLICY_KEY = pmt::string_to_symbol("gain_tag_policy");
+static const pmt::pmt_t OVERLOAD_KEY = pmt::string_to_symbol("overload");
+static const pmt::pmt_t TIMED_COMMAND_KEY = pmt::string_to_symbol("timed_command");
+static const pmt::pmt_t COMMAND_TIME_KEY = pmt::mp("time");
+static const pmt::pmt_t SETTLING_KEY = pmt::string_to_symbol("settling");
+
+// upper edges of the RSP front end bands for the settling times (the last
+// band goes up to SDRPLAY_FREQ_MAX)
+static const double settling_band_edges[] = {
+    12e6, 30e6, 60e6, 120e6, 250e6, 420e6, 1000e6
+};
+static const char* const gain_tag_policy_names[] = { "all", "interval", "threshold" };
+static const pmt::pmt_t STATUS_PORT = pmt::mp("status");
 
 const std::map<std::string, struct rsp_impl::_output_type> rsp_impl::output_types = {
     { "fc32", { OutputType::fc32, sizeof(gr_complex) } },
-    { "sc16", { OutputType::sc16, sizeof(short[2]) } }
+    { "sc16", { OutputType::sc16, sizeof(short[2]) } },
+    { "sc8", { OutputType::sc8, sizeof(signed char[2]) } },
+    { "sc12", { OutputType::sc12, sizeof(unsigned char[3]) } },
+    { "fc16", { OutputType::fc16, sizeof(uint16_t[2]) } }
 };
 
 /**********************************************************************
@@ -44,8 +67,30 @@ rsp_impl::rsp_impl(const unsigned char hwVer,
                    const std::string& selector,
                    const struct stream_args_t& stream_args,
                    std::function<bool()> specific_select) :
-    output_type(output_types.at(stream_args.output_type).output_type)
+    ring_buffer_size(static_cast<unsigned int>(stream_args.ring_buffer_size)),
+    ring_buffer_huge_pages(stream_args.ring_buffer_huge_pages),
+    split_iq(stream_args.split_iq),
+    vector_length(static_cast<unsigned int>(stream_args.vector_length)),
+    output_type(output_types.at(stream_args.output_type).output_type),
+    output_item_size(output_types.at(stream_args.output_type).size / ports_per_stream())
 {
+    if (stream_args.ring_buffer_size < MinRingBufferSize ||
+        stream_args.ring_buffer_size > MaxRingBufferSize ||
+        (stream_args.ring_buffer_size & (stream_args.ring_buffer_size - 1)) != 0) {
+        throw std::invalid_argument("invalid ring buffer size: " +
+            std::to_string(stream_args.ring_buffer_size) +
+            " (must be a power of 2 between " + std::to_string(MinRingBufferSize) +
+            " and " + std::to_string(MaxRingBufferSize) + ")");
+    }
+    if (split_iq && output_type != OutputType::fc32 && output_type != OutputType::sc16) {
+        throw std::invalid_argument("split I/Q output requires the fc32 or sc16 output type");
+    }
+    if (stream_args.vector_length < 1 || stream_args.vector_length > ring_buffer_size / 2) {
+        throw std::invalid_argument("invalid vector length: " +
+            std::to_string(stream_args.vector_length) +
+            " (must be between 1 and half the ring buffer size)");
+    }
+
     sdrplay_api::get_instance();
 
     sdrplay_api_ErrT err;
@@ -88,24 +133,64 @@ rsp_impl::rsp_impl(const unsigned char hwVer,
     nchannels = 1;
     run_status = RunStatus::idle;
 
-    ring_buffers[0].xi = nullptr;
-    ring_buffers[0].xq = nullptr;
-    ring_buffers[0].head = 0;
-    ring_buffers[0].tail = 0;
-    ring_buffers[1].xi = nullptr;
-    ring_buffers[1].xq = nullptr;
-    ring_buffers[1].head = 0;
-    ring_buffers[1].tail = 0;
-
     stream_tags = false;
+    time_tags = false;
+    gain_tag_policy = GainTagPolicy::gtp_all;
+    gain_tag_interval = 0;
+    gain_tag_threshold = 0;
+    gain_log.valid = false;
+
+    settling_mode = SettlingMode::sm_off;
+    for (int band = 0; band < NSettlingBands; band++) {
+        settling_times[band] = DefaultSettlingTime;
+        settling_measured[band] = false;
+    }
+    settling_calibration = false;
+
+    overflow_policy = OverflowPolicy::op_block;
+    dropped_samples[0] = 0;
+    dropped_samples[1] = 0;
+    pending_overflow[0] = 0;
+    pending_overflow[1] = 0;
+    pending_gap[0] = 0;
+    pending_gap[1] = 0;
+
+    low_water_mark = 0;
+    low_water_mark_in_us = false;
+    max_latency = std::chrono::microseconds(10000);
+    direct_handoff = false;
+
+    sc8_shift_setting = -1;
 
     sample_sequence_gaps_check = false;
+    sample_gaps_fill = false;
+    for (int i = 0; i < 2; i++) {
+        sample_gaps_count[i] = 0;
+        sample_gaps_missing[i] = 0;
+    }
+
+    status_interval = std::chrono::duration<double>(0);
+    status_stop = true;
     show_gain_changes = false;
 
+    timed_command_id = 0;
+    timed_commands_queued = false;
+    timed_commands_new.allocate(MaxTimedCommands);
+    timed_commands_due.allocate(MaxTimedCommands);
+    timed_commands_done.allocate(MaxTimedCommands);
+    timed_schedule.reserve(MaxTimedCommands);
+    timed_command_latency = 0;
+    command_stop = true;
+
+    // selected again in start(), once the number of channels is known
+    select_convert_function();
+    select_work_function();
+
     // Set up message ports
     message_port_register_in(pmt::mp("command"));
     set_msg_handler(pmt::mp("command"),
-                    [this](const pmt::pmt_t& msg) { this->handle_command(msg); });
+                    [this](const pmt::pmt_t& msg) { this->handle_command_message(msg); });
+    message_port_register_out(STATUS_PORT);
 }
 
 rsp_impl::~rsp_impl()
@@ -113,13 +198,8 @@ rsp_impl::~rsp_impl()
     if (run_status >= RunStatus::init)
         stop();
 
-    // unset the ring buffers
-    ring_buffers[0].xi = nullptr;
-    ring_buffers[0].xq = nullptr;
-    ring_buffers[1].xi = nullptr;
-    ring_buffers[1].xq = nullptr;
-
-    d_logger->info("total samples: [{},{}]", ring_buffers[0].head, ring_buffers[1].head);
+    d_logger->info("total samples: [{},{}]", ring_buffers[0].write_index(),
+                   ring_buffers[1].write_index());
 
     sdrplay_api_ErrT err;
     err = sdrplay_api_ReleaseDevice(&device);
@@ -130,9 +210,15 @@ rsp_impl::~rsp_impl()
 
 io_signature::sptr rsp_impl::args_to_io_sig(const struct stream_args_t& args) const
 {
-    const int nchan = std::max<int>(static_cast<int>(args.channels_size), 1);
-    const int size = static_cast<int>(output_types.at(args.output_type).size);
-    return io_signature::make(nchan, nchan, size);
+    int nports = std::max<int>(static_cast<int>(args.channels_size), 1);
+    int size = static_cast<int>(output_types.at(args.output_type).size *
+                                std::max<size_t>(args.vector_length, 1));
+    if (args.split_iq) {
+        // I and Q on separate ports
+        nports *= 2;
+        size /= 2;
+    }
+    return io_signature::make(nports, nports, size);
 }
 
 
@@ -528,11 +614,6 @@ void rsp_impl::set_agc_setpoint(double set_point)
 
 
 // Streaming methods
-static void sample_copy_fc32(size_t start, size_t end, int noutput_items,
-                             short *xi, short *xq, void *out);
-static void sample_copy_sc16(size_t start, size_t end, int noutput_items,
-                             short *xi, short *xq, void *out);
-
 bool rsp_impl::start()
 {
     //print_device_config();
@@ -545,6 +626,9 @@ bool rsp_impl::start()
 
 bool rsp_impl::stop()
 {
+    stop_status_thread();
+    stop_command_thread();
+
     sdrplay_api_ErrT err;
     if (run_status >= RunStatus::init) {
         err = sdrplay_api_Uninit(device.dev);
@@ -555,11 +639,21 @@ bool rsp_impl::stop()
     }
     run_status = RunStatus::idle;
 
-    // notify the callback threads so they can terminate
-    ring_buffers[0].tail = ring_buffers[0].head;
-    ring_buffers[1].tail = ring_buffers[1].head;
-    ring_buffers[0].overflow.notify_one();
-    ring_buffers[1].overflow.notify_one();
+    // notify the callback threads (and work()) so they can terminate
+    ring_buffers[0].abort();
+    ring_buffers[1].abort();
+
+    // the sample indexes start over with the next start(); the commands
+    // queued while stopped are kept
+    if (!timed_schedule.empty()) {
+        d_logger->warn("{} timed commands not executed", timed_schedule.size());
+        std::lock_guard<std::mutex> lock(command_mutex);
+        for (const auto& sc : timed_schedule)
+            timed_command_msgs.erase(sc.id);
+        timed_schedule.clear();
+    }
+    timed_commands_due.reset();
+    timed_commands_done.reset();
 
     return true;
 }
@@ -572,55 +666,167 @@ int rsp_impl::work(int noutput_items,
         return 0;
     run_status = RunStatus::streaming;
 
-    int nstreams = static_cast<int>(output_items.size());
+    // always return whole vectors, and a multiple of output_multiple() of
+    // them (noutput_items is one already)
+    uint64_t max_samples = static_cast<uint64_t>(noutput_items) * vector_length;
+    uint64_t granularity = static_cast<uint64_t>(output_multiple()) * vector_length;
+
+    uint64_t min_samples = 1;
+    if (low_water_mark > 0) {
+        double lwm = low_water_mark_in_us ? low_water_mark * 1e-6 * sample_rate :
+                                            low_water_mark;
+        // no point in waiting for more than what fits in the output buffer
+        // (or in the ring buffer)
+        min_samples = static_cast<uint64_t>(std::max(lwm, 1.0));
+        min_samples = std::min<uint64_t>(min_samples, max_samples);
+        min_samples = std::min<uint64_t>(min_samples, ring_buffer_size / 2);
+    }
+    min_samples = std::max(min_samples, granularity);
+
+    // the samples handed off are never written to the ring, so drop_oldest
+    // could hand out stale data in their place
+    bool handoff = direct_handoff && min_samples == granularity &&
+                   overflow_policy != OverflowPolicy::op_drop_oldest;
+
+    work_function fn = work_fn.load(std::memory_order_relaxed);
+    return fn(this, max_samples, output_items, min_samples, granularity, handoff);
+}
+
+template <int NStreams, int NPlanes, bool Tags>
+int rsp_impl::work_streams(uint64_t max_samples,
+                           gr_vector_void_star& output_items,
+                           uint64_t min_samples, uint64_t granularity,
+                           bool handoff)
+{
+    auto work_start = std::chrono::steady_clock::now();
+
     // start from the highest stream and go down to stream 0 since the streams
     // are produced in ascending order and we want to make sure we have at
     // least the same number of samples to return
-    for (int stream_index = nstreams - 1; stream_index >= 0; --stream_index) {
+    for (int stream_index = NStreams - 1; stream_index >= 0; --stream_index) {
         auto& ring_buffer = ring_buffers[stream_index];
-        void *out = output_items[stream_index];
-
-        std::unique_lock<std::mutex> lock(ring_buffer.mtx);
 
-        ring_buffer.empty.wait(lock, [&ring_buffer]() {
-                return ring_buffer.tail < ring_buffer.head;
-        });
-
-        int nsamples = ring_buffer.head - ring_buffer.tail;
-        noutput_items = std::min(nsamples, noutput_items);
-        uint64_t new_tail = ring_buffer.tail + noutput_items;
-        size_t start = static_cast<size_t>(ring_buffer.tail & RingBufferMask);
-        size_t end = static_cast<size_t>(new_tail & RingBufferMask);
-        if (output_type == OutputType::fc32) {
-            sample_copy_fc32(start, end, noutput_items, ring_buffer.xi,
-                             ring_buffer.xq, output_items[stream_index]);
-        } else if (output_type == OutputType::sc16) {
-            sample_copy_sc16(start, end, noutput_items, ring_buffer.xi,
-                             ring_buffer.xq, output_items[stream_index]);
+        // with the drop_oldest overflow policy the stream callback may have
+        // overwritten the samples while they were being copied; in that case
+        // just read them again from the new tail
+        uint64_t tail;
+        unsigned int nitems;
+        ring_buffer::handoff_buffer handoff_buffer;
+        ring_buffer::handoff_buffer *offer = nullptr;
+        if (handoff) {
+            for (int plane = 0; plane < NPlanes; plane++)
+                handoff_buffer.out[plane] = static_cast<char *>(output_items[NPlanes * stream_index + plane]);
+            handoff_buffer.capacity = static_cast<unsigned int>(max_samples);
+            handoff_buffer.granularity = static_cast<unsigned int>(granularity);
+            offer = &handoff_buffer;
         }
-        ring_buffer.tail = new_tail;
+        do {
+            uint64_t nsamples = ring_buffer.wait_for_data(tail, min_samples,
+                                                          max_latency, granularity,
+                                                          offer);
+            if (nsamples == 0)
+                return 0;
+
+            nitems = static_cast<unsigned int>(std::min(nsamples, max_samples));
+            nitems -= nitems % granularity;
+            // the first ones may have been handed off by the stream callback
+            unsigned int nhandoff = offer ? offer->count : 0;
+            for (int plane = 0; plane < NPlanes; plane++) {
+                int port = NPlanes * stream_index + plane;
+                // already converted to the output type
+                ring_buffer.read(tail + nhandoff,
+                                 static_cast<char *>(output_items[port]) +
+                                     nhandoff * ring_buffer.item_size,
+                                 nitems - nhandoff, plane);
+            }
+        } while (!ring_buffer.commit_read(tail, tail + nitems));
+        max_samples = nitems;
 
-        if (stream_tags) {
-            add_stream_tags(start, end, noutput_items, stream_index);
+        if constexpr (Tags) {
+            add_stream_tags(tail, nitems, stream_index);
         }
 
-        ring_buffer.overflow.notify_one();
+        auto& st = stats[stream_index];
+        stream_stats::add(st.work_calls, 1);
+        stream_stats::add(st.work_samples, nitems);
+        st.work_time.add(std::chrono::steady_clock::now() - work_start);
     }
 
-    return noutput_items;
+    return static_cast<int>(max_samples / vector_length);
+}
+
+template <int NStreams, int NPlanes>
+rsp_impl::work_function rsp_impl::work_function_for(bool tags)
+{
+    return tags ? work_streams_fn<NStreams, NPlanes, true> :
+                  work_streams_fn<NStreams, NPlanes, false>;
+}
+
+void rsp_impl::select_work_function()
+{
+    // anything that can queue a param change needs the tags path
+    bool tags = stream_tags || time_tags || sample_gaps_fill ||
+                overflow_policy != OverflowPolicy::op_block ||
+                output_type == OutputType::sc8 || timed_commands_queued ||
+                settling_mode != SettlingMode::sm_off;
+    work_function fn;
+    if (nchannels == 2) {
+        fn = split_iq ? work_function_for<2, 2>(tags) :
+                        work_function_for<2, 1>(tags);
+    } else {
+        fn = split_iq ? work_function_for<1, 2>(tags) :
+                        work_function_for<1, 1>(tags);
+    }
+    work_fn.store(fn, std::memory_order_relaxed);
 }
 
 bool rsp_impl::start_api_init()
 {
-    // set the ring buffers
-    ring_buffers[0].xi = new short[RingBufferSize];
-    ring_buffers[0].xq = new short[RingBufferSize];
-    ring_buffers[0].head = 0;
-    ring_buffers[0].tail = 0;
-    ring_buffers[1].xi = nchannels > 1 ? new short[RingBufferSize] : nullptr;
-    ring_buffers[1].xq = nchannels > 1 ? new short[RingBufferSize] : nullptr;
-    ring_buffers[1].head = 0;
-    ring_buffers[1].tail = 0;
+    // set the ring buffers (the memory is reused across start/stop cycles)
+    for (int i = 0; i < 2; i++) {
+        param_changes[i].allocate(param_change_queue_size());
+        pending_changes[i].clear();
+        pending_changes[i].reserve(param_change_queue_size());
+        gain_tags[i].valid = false;
+        gain_tags[i].pending = false;
+        gain_tag_policy_changed[i] = true;
+        overload[i] = false;
+        overload_reported[i] = false;
+        settling_left[i] = 0;
+        pending_settling[i] = 0;
+        pending_settling_zero[i] = false;
+        settling_measurements[i].active = false;
+        pending_overflow[i] = 0;
+        pending_gap[i] = 0;
+        clock_models[i].reset(sample_rate);
+        sample_num_valid[i] = false;
+        time_tag_pending[i] = true;
+        sc8_shift[i] = -1;
+        sc8_peak[i] = 0;
+    }
+    for (int i = 0; i < nchannels; i++) {
+        auto& ring_buffer = ring_buffers[i];
+        try {
+            ring_buffer.allocate(ring_buffer_size, output_item_size,
+                                 ring_buffer_huge_pages, ports_per_stream());
+        } catch (const std::bad_alloc&) {
+            d_logger->error("ring buffer allocation failed - size={}", ring_buffer_size);
+            return false;
+        }
+        if (ring_buffer_huge_pages && i == 0) {
+            if (!ring_buffer.has_huge_pages())
+                d_logger->warn("huge pages not available for the ring buffers - using regular pages");
+            if (!ring_buffer.is_locked())
+                d_logger->warn("mlock() of the ring buffers failed - check the memlock limit (ulimit -l)");
+        }
+    }
+    if (static_cast<uint64_t>(output_multiple()) * vector_length > ring_buffer_size / 2) {
+        d_logger->error("output multiple too large for the ring buffer size - output_multiple={} vector_length={}",
+                        output_multiple(), vector_length);
+        return false;
+    }
+    select_convert_function();
+    select_work_function();
 
     sdrplay_api_CallbackFnsT callbackFns = {
         stream_A_callback,
@@ -633,6 +839,8 @@ bool rsp_impl::start_api_init()
         d_logger->error("sdrplay_api_Init() Error: {}", sdrplay_api_GetErrorString(err));
         return false;
     }
+    start_status_thread();
+    start_command_thread();
     return true;
 }
 
@@ -640,130 +848,386 @@ bool rsp_impl::start_api_init()
 void rsp_impl::set_stream_tags(bool enable)
 {
     stream_tags = enable;
+    select_work_function();
 }
 
-// internal functions
-static void sample_copy_fc32(size_t start, size_t end, int noutput_items,
-                             short *xi, short *xq, void *out)
+void rsp_impl::set_time_tags(bool enable)
 {
-    if (noutput_items == 0)
+    time_tags = enable;
+    select_work_function();
+}
+
+double rsp_impl::get_clock_drift_ppm(int stream_index) const
+{
+    if (stream_index < 0 || stream_index > 1) {
+        d_logger->error("invalid stream index: {}", stream_index);
+        return 0;
+    }
+    return clock_models[stream_index].drift_ppm();
+}
+
+// Gain tag policy
+void rsp_impl::set_gain_tag_policy(const std::string& policy, const double value)
+{
+    if (policy == "all") {
+        gain_tag_policy = GainTagPolicy::gtp_all;
+    } else if (policy == "interval") {
+        if (value < 1) {
+            d_logger->error("invalid gain tag interval: {}", value);
+            return;
+        }
+        gain_tag_interval = static_cast<uint64_t>(value);
+        gain_tag_policy = GainTagPolicy::gtp_interval;
+    } else if (policy == "threshold") {
+        if (value < 0) {
+            d_logger->error("invalid gain tag threshold: {}", value);
+            return;
+        }
+        gain_tag_threshold = value;
+        gain_tag_policy = GainTagPolicy::gtp_threshold;
+    } else {
+        d_logger->error("invalid gain tag policy: {}", policy);
         return;
-    short *from = xi + start;
-    gr_complex *to = static_cast<gr_complex *>(out);
-    if (end > start || end == 0) {
-        // no wrap around case
-        size_t size = noutput_items;
-        for (int i = 0; i < size; ++i)
-            to[i].real(static_cast<float>(from[i]) / 32768.0f);
-        from = xq + start;
-        for (int i = 0; i < size; ++i)
-            to[i].imag(static_cast<float>(from[i]) / 32768.0f);
+    }
+    for (auto& changed : gain_tag_policy_changed)
+        changed.store(true, std::memory_order_relaxed);
+}
+
+// Settling transients
+int rsp_impl::settling_band(double freq)
+{
+    return std::upper_bound(std::begin(settling_band_edges),
+                            std::end(settling_band_edges), freq) -
+           std::begin(settling_band_edges);
+}
+
+void rsp_impl::set_settling(const std::string& mode, const double settling_time)
+{
+    if (mode == "off") {
+        settling_mode = SettlingMode::sm_off;
+    } else if (mode == "zero") {
+        settling_mode = SettlingMode::sm_zero;
+    } else if (mode == "drop") {
+        settling_mode = SettlingMode::sm_drop;
     } else {
-        // wrap around case
-        size_t size = noutput_items - end;
-        for (int i = 0; i < size; ++i)
-            to[i].real(static_cast<float>(from[i]) / 32768.0f);
-        from = xq + start;
-        for (int i = 0; i < size; ++i)
-            to[i].imag(static_cast<float>(from[i]) / 32768.0f);
-        from = xi;
-        to += size;
-        size = end;
-        for (int i = 0; i < size; ++i)
-            to[i].real(static_cast<float>(from[i]) / 32768.0f);
-        from = xq;
-        for (int i = 0; i < size; ++i)
-            to[i].imag(static_cast<float>(from[i]) / 32768.0f);
+        d_logger->error("invalid settling mode: {}", mode);
+        return;
     }
-    return;
+    if (settling_time >= 0) {
+        for (auto& time : settling_times)
+            time.store(settling_time, std::memory_order_relaxed);
+    }
+    select_work_function();
 }
 
-static void sample_copy_sc16(size_t start, size_t end, int noutput_items,
-                             short *xi, short *xq, void *out)
+void rsp_impl::set_band_settling_time(const double freq, const double settling_time)
 {
-    if (noutput_items == 0)
+    if (settling_time < 0) {
+        d_logger->error("invalid settling time: {}", settling_time);
         return;
-    short *from = xi + start;
-    short (*to)[2] = static_cast<short (*)[2]>(out);
-    if (end > start || end == 0) {
-        // no wrap around case
-        size_t size = noutput_items;
-        for (int i = 0; i < size; ++i)
-            to[i][0] = from[i];
-        from = xq + start;
-        for (int i = 0; i < size; ++i)
-            to[i][1] = from[i];
+    }
+    settling_times[settling_band(freq)].store(settling_time, std::memory_order_relaxed);
+}
+
+double rsp_impl::get_band_settling_time(const double freq) const
+{
+    return settling_times[settling_band(freq)].load(std::memory_order_relaxed);
+}
+
+void rsp_impl::set_settling_calibration(bool enable)
+{
+    if (enable && !settling_calibration) {
+        for (auto& measured : settling_measured)
+            measured.store(false, std::memory_order_relaxed);
+    }
+    settling_calibration = enable;
+}
+
+// Overflow policy
+void rsp_impl::set_overflow_policy(const std::string& policy)
+{
+    if (policy == "block") {
+        overflow_policy = OverflowPolicy::op_block;
+    } else if (policy == "drop_newest") {
+        overflow_policy = OverflowPolicy::op_drop_newest;
+    } else if (policy == "drop_oldest") {
+        overflow_policy = OverflowPolicy::op_drop_oldest;
     } else {
-        // wrap around case
-        size_t size = noutput_items - end;
-        for (int i = 0; i < size; ++i)
-            to[i][0] = from[i];
-        from = xq + start;
-        for (int i = 0; i < size; ++i)
-            to[i][1] = from[i];
-        from = xi;
-        to += size;
-        size = end;
-        for (int i = 0; i < size; ++i)
-            to[i][0] = from[i];
-        from = xq;
-        for (int i = 0; i < size; ++i)
-            to[i][1] = from[i];
+        d_logger->error("invalid overflow policy: {}", policy);
+        return;
     }
-    return;
+    select_work_function();
+}
+
+uint64_t rsp_impl::get_dropped_samples(int stream_index) const
+{
+    if (stream_index < 0 || stream_index > 1) {
+        d_logger->error("invalid stream index: {}", stream_index);
+        return 0;
+    }
+    return dropped_samples[stream_index].load(std::memory_order_relaxed);
+}
+
+// sc8 output scaling
+void rsp_impl::set_sc8_shift(int shift)
+{
+    if (shift < -1 || shift > 8) {
+        d_logger->error("invalid sc8 shift: {}", shift);
+        return;
+    }
+    sc8_shift_setting = shift;
+}
+
+// Batched wake ups
+void rsp_impl::set_low_water_mark(const double low_water_mark,
+                                  const std::string& units)
+{
+    if (low_water_mark < 0) {
+        d_logger->error("invalid low water mark: {:g}", low_water_mark);
+        return;
+    }
+    if (units == "samples") {
+        low_water_mark_in_us = false;
+    } else if (units == "us") {
+        low_water_mark_in_us = true;
+    } else {
+        d_logger->error("invalid low water mark units: {}", units);
+        return;
+    }
+    this->low_water_mark = low_water_mark;
+}
+
+void rsp_impl::set_max_latency(const double max_latency)
+{
+    if (max_latency < 0) {
+        d_logger->error("invalid max latency: {:g}us", max_latency);
+        return;
+    }
+    this->max_latency = std::chrono::microseconds(static_cast<long long>(max_latency));
+}
+
+void rsp_impl::set_direct_handoff(bool enable)
+{
+    direct_handoff = enable;
+}
+
+// Statistics
+pmt::pmt_t rsp_impl::get_stats() const
+{
+    auto histogram_to_pmt = [](const stream_stats::histogram& h) {
+        std::vector<uint64_t> buckets(stream_stats::histogram::NBuckets);
+        for (int i = 0; i < stream_stats::histogram::NBuckets; i++)
+            buckets[i] = h.bucket(i);
+        return pmt::init_u64vector(buckets.size(), buckets);
+    };
+
+    pmt::pmt_t stats_dict = pmt::make_dict();
+    for (int i = 0; i < nchannels; i++) {
+        const stream_stats& st = stats[i];
+        uint64_t work_calls = st.work_calls.load(std::memory_order_relaxed);
+        uint64_t work_samples = st.work_samples.load(std::memory_order_relaxed);
+        pmt::pmt_t d = pmt::make_dict();
+        d = pmt::dict_add(d, pmt::mp("callbacks"),
+                          pmt::from_uint64(st.callbacks.load(std::memory_order_relaxed)));
+        d = pmt::dict_add(d, pmt::mp("samples"),
+                          pmt::from_uint64(st.samples.load(std::memory_order_relaxed)));
+        d = pmt::dict_add(d, pmt::mp("overflow_waits"),
+                          pmt::from_uint64(st.overflow_waits.load(std::memory_order_relaxed)));
+        d = pmt::dict_add(d, pmt::mp("overflow_wait_time"),
+                          pmt::from_double(st.overflow_wait_ns.load(std::memory_order_relaxed) * 1e-9));
+        d = pmt::dict_add(d, pmt::mp("dropped_samples"),
+                          pmt::from_uint64(dropped_samples[i].load(std::memory_order_relaxed)));
+        d = pmt::dict_add(d, pmt::mp("work_calls"), pmt::from_uint64(work_calls));
+        d = pmt::dict_add(d, pmt::mp("work_samples"), pmt::from_uint64(work_samples));
+        d = pmt::dict_add(d, pmt::mp("samples_per_work"),
+                          pmt::from_double(work_calls > 0 ? static_cast<double>(work_samples) / work_calls : 0));
+        d = pmt::dict_add(d, pmt::mp("ring_size"), pmt::from_uint64(ring_buffer_size));
+        d = pmt::dict_add(d, pmt::mp("ring_fill_max"),
+                          pmt::from_uint64(st.ring_fill_max.load(std::memory_order_relaxed)));
+        d = pmt::dict_add(d, pmt::mp("handoff_samples"),
+                          pmt::from_uint64(st.handoff_samples.load(std::memory_order_relaxed)));
+        d = pmt::dict_add(d, pmt::mp("dropped_tags"),
+                          pmt::from_uint64(st.dropped_tags.load(std::memory_order_relaxed)));
+        d = pmt::dict_add(d, pmt::mp("overloads"),
+                          pmt::from_uint64(st.overloads.load(std::memory_order_relaxed)));
+        d = pmt::dict_add(d, pmt::mp("overload_samples"),
+                          pmt::from_uint64(st.overload_samples.load(std::memory_order_relaxed)));
+        d = pmt::dict_add(d, pmt::mp("settling_samples"),
+                          pmt::from_uint64(st.settling_samples.load(std::memory_order_relaxed)));
+        d = pmt::dict_add(d, pmt::mp("gaps"),
+                          pmt::from_uint64(sample_gaps_count[i].load(std::memory_order_relaxed)));
+        d = pmt::dict_add(d, pmt::mp("gap_samples"),
+                          pmt::from_uint64(sample_gaps_missing[i].load(std::memory_order_relaxed)));
+        d = pmt::dict_add(d, pmt::mp("clock_drift_ppm"),
+                          pmt::from_double(clock_models[i].drift_ppm()));
+        // power of 2 buckets in us (bucket 0 is < 1us, bucket i is [2^(i-1), 2^i) us)
+        d = pmt::dict_add(d, pmt::mp("callback_interval_histogram"),
+                          histogram_to_pmt(st.callback_interval));
+        d = pmt::dict_add(d, pmt::mp("work_time_histogram"),
+                          histogram_to_pmt(st.work_time));
+        stats_dict = pmt::dict_add(stats_dict, pmt::mp("stream" + std::to_string(i)), d);
+    }
+    return stats_dict;
+}
+
+void rsp_impl::set_status_interval(const double interval)
+{
+    if (interval < 0) {
+        d_logger->error("invalid status interval: {:g}s", interval);
+        return;
+    }
+    std::lock_guard<std::mutex> lock(status_mutex);
+    status_interval = std::chrono::duration<double>(interval);
+    status_cv.notify_all();
+}
+
+void rsp_impl::start_status_thread()
+{
+    stop_status_thread();
+    status_stop = false;
+    status_thread = std::thread(&rsp_impl::status_loop, this);
+}
+
+void rsp_impl::stop_status_thread()
+{
+    {
+        std::lock_guard<std::mutex> lock(status_mutex);
+        status_stop = true;
+        status_cv.notify_all();
+    }
+    if (status_thread.joinable())
+        status_thread.join();
 }
 
-void rsp_impl::add_stream_tags(size_t start, size_t end, int noutput_items,
+void rsp_impl::status_loop()
+{
+    std::unique_lock<std::mutex> lock(status_mutex);
+    while (!status_stop) {
+        if (status_interval.count() <= 0) {
+            // disabled - wait for a new interval (or stop)
+            status_cv.wait(lock);
+            continue;
+        }
+        auto interval = status_interval;
+        if (status_cv.wait_for(lock, interval, [this, interval]() {
+                return status_stop || status_interval != interval;
+            }))
+            continue;
+        lock.unlock();
+        message_port_pub(STATUS_PORT, get_stats());
+        lock.lock();
+    }
+}
+
+// internal functions
+void rsp_impl::add_stream_tags(uint64_t start, int noutput_items,
                                int stream_index)
 {
     if (noutput_items == 0)
         return;
-    while (!param_changes[stream_index].empty()) {
-        struct param_change &pc = param_changes[stream_index].front();
-        size_t relative_offset = pc.offset - start;
-        if (end > start || end == 0) {
-            // no wrap around case
-            relative_offset = pc.offset - start;
-        } else {
-            // wrap around case
-            if (pc.offset >= start && pc.offset < start + (noutput_items - end)) {
-                relative_offset = pc.offset - start;
-            } else if (pc.offset >= 0 && pc.offset < end) {
-                relative_offset = pc.offset - (noutput_items - end);
-            } else {
-                relative_offset = -1;
-            }
-        }
-        if (!(relative_offset >= 0 && relative_offset < noutput_items)) {
-            break;
-        }
-        unsigned long offset = nitems_written(stream_index) + relative_offset;
+    uint64_t end = start + noutput_items;
+    // all the changes queued since the last call, in one batch without
+    // locks
+    auto& changes = pending_changes[stream_index];
+    size_t nold = changes.size();
+    param_changes[stream_index].drain([&changes](const struct param_change &pc) {
+        changes.push_back(pc);
+        return true;
+    });
+    // drop_oldest queues its tags at the new tail, before the changes
+    // already queued for the samples after it
+    auto by_offset = [](const struct param_change &a, const struct param_change &b) {
+        return a.offset < b.offset;
+    };
+    if (!std::is_sorted(changes.begin() + (nold > 0 ? nold - 1 : 0), changes.end(), by_offset))
+        std::stable_sort(changes.begin(), changes.end(), by_offset);
+
+    size_t n = 0;
+    for (; n < changes.size() && changes[n].offset < end; n++) {
+        const struct param_change &pc = changes[n];
+        // the time of the samples that have been dropped does not apply
+        // to the first sample read (it has its own rx_time tag)
+        if (pc.pctype == pct_time && pc.offset < start)
+            continue;
+        // changes for samples that have been dropped are added to the
+        // first sample read (and with vectors to the vector with the sample)
+        uint64_t relative_offset = pc.offset > start ? (pc.offset - start) / vector_length : 0;
+        pmt::pmt_t key;
+        pmt::pmt_t value;
         switch (pc.pctype) {
         case pct_rate:
-            add_item_tag(stream_index, offset, RATE_KEY, pmt::from_double(pc.rate));
+            key = RATE_KEY;
+            value = pmt::from_double(pc.rate);
             break;
         case pct_freq:
-            add_item_tag(stream_index, offset, FREQ_KEY, pmt::from_double(pc.freq));
+            key = FREQ_KEY;
+            value = pmt::from_double(pc.freq);
             break;
         case pct_gains:
-            add_item_tag(stream_index, offset, GAINS_KEY,
-                         pmt::make_tuple(pmt::from_long(pc.gains[0]),
-                                         pmt::from_long(pc.gains[1])));
+            key = GAINS_KEY;
+            value = pmt::make_tuple(pmt::from_long(pc.gains[0]),
+                                    pmt::from_long(pc.gains[1]));
+            break;
+        case pct_overflow:
+            key = OVERFLOW_KEY;
+            value = pmt::from_uint64(pc.dropped);
+            break;
+        case pct_gap:
+            key = GAP_KEY;
+            value = pmt::from_uint64(pc.missing);
+            break;
+        case pct_scale:
+            key = SCALE_KEY;
+            value = pmt::from_double(pc.scale);
+            break;
+        case pct_time:
+            key = TIME_KEY;
+            value = pmt::make_tuple(pmt::from_uint64(pc.time.full_secs),
+                                    pmt::from_double(pc.time.frac_secs));
+            break;
+        case pct_overload:
+            key = OVERLOAD_KEY;
+            value = pmt::from_bool(pc.overload);
+            break;
+        case pct_settling:
+            key = SETTLING_KEY;
+            value = pmt::from_uint64(pc.settling);
+            break;
+        case pct_timed_command:
+            key = TIMED_COMMAND_KEY;
+            value = pmt::make_tuple(pmt::from_uint64(pc.timed_command.index),
+                                    pc.timed_command.measured ?
+                                        pmt::from_long(pc.timed_command.error) :
+                                        pmt::PMT_F);
+            break;
+        case pct_gain_tag_policy:
+            key = GAIN_TAG_POLICY_KEY;
+            value = pmt::make_tuple(pmt::mp(gain_tag_policy_names[pc.gain_tag_policy.policy]),
+                                    pmt::from_double(pc.gain_tag_policy.value));
             break;
         }
-        {
-            std::unique_lock<std::mutex> lock(param_change_mutex[stream_index]);
-            param_changes[stream_index].pop();
+        // with split I/Q the tags go on both the I and the Q port
+        for (int plane = 0; plane < ports_per_stream(); plane++) {
+            int port = first_port(stream_index) + plane;
+            add_item_tag(port, nitems_written(port) + relative_offset, key, value);
         }
     }
-    return;
+    changes.erase(changes.begin(), changes.begin() + n);
+}
+
+void rsp_impl::push_param_change(int stream_index, const struct param_change& pc)
+{
+    // only the stream callback of this stream pushes to the queue
+    if (!param_changes[stream_index].push(pc)) {
+        stream_stats::add(stats[stream_index].dropped_tags, 1);
+    }
 }
 
 
 // callback functions
 static void sample_gaps_check(unsigned int num_samples,
-                              unsigned int first_sample_num,
-                              unsigned int& next_sample_num,
+                              uint64_t first_sample_num,
+                              uint64_t next_sample_num,
                               gr::logger_ptr logger,
                               int stream_index);
 
@@ -773,11 +1237,6 @@ void rsp_impl::stream_A_callback(short *xi, short *xq,
                                  void *cbContext)
 {
     rsp_impl *rsp = static_cast<rsp_impl *>(cbContext);
-    if (rsp->sample_sequence_gaps_check) {
-        static unsigned int next_sample_num = 0;
-        sample_gaps_check(numSamples, params->firstSampleNum, next_sample_num,
-                          rsp->d_logger, 0);
-    }
     rsp->sample_rate_changed |= params->fsChanged;
     rsp->frequency_changed |= params->rfChanged;
     rsp->gain_reduction_changed |= params->grChanged;
@@ -795,11 +1254,6 @@ void rsp_impl::stream_B_callback(short *xi, short *xq,
                                  void *cbContext)
 {
     rsp_impl *rsp = static_cast<rsp_impl *>(cbContext);
-    if (rsp->sample_sequence_gaps_check) {
-        static unsigned int next_sample_num = 0;
-        sample_gaps_check(numSamples, params->firstSampleNum, next_sample_num,
-                          rsp->d_logger, 1);
-    }
     rsp->sample_rate_changed |= params->fsChanged;
     rsp->frequency_changed |= params->rfChanged;
     rsp->gain_reduction_changed |= params->grChanged;
@@ -826,75 +1280,687 @@ void rsp_impl::stream_callback(short *xi, short *xq,
                                int stream_index,
                                sdrplay_api_RxChannelParamsT *rx_params)
 {
-    int ring_buffer_overflow = RingBufferSize - numSamples;
+    auto arrival = std::chrono::steady_clock::now();
     auto& ring_buffer = ring_buffers[stream_index];
 
-    std::unique_lock<std::mutex> lock(ring_buffer.mtx);
+    auto& st = stats[stream_index];
+    if (st.callbacks.load(std::memory_order_relaxed) > 0)
+        st.callback_interval.add(arrival - st.last_callback);
+    st.last_callback = arrival;
+    stream_stats::add(st.callbacks, 1);
+    stream_stats::add(st.samples, numSamples);
+
+    // unwrap the 32 bit sample number (tracked per stream)
+    uint64_t sample_num;
+    uint64_t gap = 0;
+    if (!sample_num_valid[stream_index] || reset || params->fsChanged) {
+        clock_models[stream_index].reset(sample_rate);
+        sample_num = params->firstSampleNum;
+        sample_num_valid[stream_index] = true;
+        time_tag_pending[stream_index] = true;
+    } else {
+        uint64_t expected = next_sample_num[stream_index];
+        int32_t delta = static_cast<int32_t>(params->firstSampleNum -
+                                             static_cast<uint32_t>(expected));
+        sample_num = expected + delta;
+        if (delta != 0) {
+            if (sample_sequence_gaps_check) {
+                sample_gaps_check(numSamples, sample_num, expected, d_logger,
+                                  stream_index);
+            }
+            if (delta < 0) {
+                time_tag_pending[stream_index] = true;
+            } else {
+                gap = delta;
+                sample_gaps_count[stream_index].fetch_add(1, std::memory_order_relaxed);
+                sample_gaps_missing[stream_index].fetch_add(gap, std::memory_order_relaxed);
+            }
+        }
+    }
+    next_sample_num[stream_index] = sample_num + numSamples;
+    // update the clock model with the arrival time of the end of this packet
+    clock_models[stream_index].update(sample_num + numSamples, arrival);
+
+    // zero samples to fill the gap (if enabled)
+    unsigned int nfill = 0;
+    if (gap > 0 && sample_gaps_fill) {
+        nfill = static_cast<unsigned int>(std::min<uint64_t>(gap, ring_buffer.size / 2));
+    }
+    if (nfill < gap) {
+        time_tag_pending[stream_index] = true;
+    }
 
-    ring_buffer.overflow.wait(lock, [&ring_buffer, ring_buffer_overflow]() {
-            return ring_buffer.tail + ring_buffer_overflow >= ring_buffer.head;
-    });
+    // blank the settling transient after a retune or a gain change (the
+    // AGC changes the gains all the time, so not its changes)
+    unsigned int nblank = 0;
+    bool gains_set = params->grChanged &&
+                     rx_params->ctrlParams.agc.enable == sdrplay_api_AGC_DISABLE;
+    if (params->rfChanged || gains_set) {
+        int band = settling_band(rx_params->tunerParams.rfFreq.rfHz);
+        if (settling_mode != SettlingMode::sm_off) {
+            settling_left[stream_index] = static_cast<uint64_t>(
+                settling_times[band].load(std::memory_order_relaxed) * 1e-6 * sample_rate);
+            // (tagged on the first packet kept, in case this one is dropped)
+            pending_settling_zero[stream_index] = settling_mode == SettlingMode::sm_zero;
+        }
+        if (settling_calibration) {
+            auto& m = settling_measurements[stream_index];
+            m.active = true;
+            m.band = band;
+            m.window = std::max(256u, static_cast<unsigned int>(sample_rate * 50e-6));
+            m.count = 0;
+            m.power = 0;
+            m.nwindows = 0;
+        }
+    }
+    if (settling_measurements[stream_index].active) {
+        measure_settling(stream_index, xi, xq, numSamples);
+    }
+    if (settling_left[stream_index] > 0) {
+        nblank = static_cast<unsigned int>(std::min<uint64_t>(settling_left[stream_index],
+                                                              numSamples));
+        settling_left[stream_index] -= nblank;
+        stream_stats::add(st.settling_samples, nblank);
+        if (settling_mode == SettlingMode::sm_drop) {
+            // as if these samples never arrived (one discontinuity for the
+            // whole settling time)
+            if (pending_settling[stream_index] == 0)
+                time_tag_pending[stream_index] = true;
+            pending_settling[stream_index] += nblank;
+            xi += nblank;
+            xq += nblank;
+            numSamples -= nblank;
+            sample_num += nblank;
+            nblank = 0;
+        }
+    }
+    unsigned int nwrite = nfill + numSamples;
+
+    bool drop = false;
+    uint64_t dropped_oldest = 0;
+    switch (overflow_policy) {
+    case OverflowPolicy::op_block:
+        if (!ring_buffer.has_space(nwrite)) {
+            auto wait_start = std::chrono::steady_clock::now();
+            bool ok = ring_buffer.wait_for_space(nwrite);
+            auto wait_time = std::chrono::steady_clock::now() - wait_start;
+            stream_stats::add(st.overflow_waits, 1);
+            stream_stats::add(st.overflow_wait_ns,
+                std::chrono::duration_cast<std::chrono::nanoseconds>(wait_time).count());
+            if (!ok) {
+                return;
+            }
+        }
+        break;
+    case OverflowPolicy::op_drop_newest:
+        drop = !ring_buffer.has_space(nwrite);
+        break;
+    case OverflowPolicy::op_drop_oldest:
+        if (nwrite <= ring_buffer.size) {
+            dropped_oldest = ring_buffer.drop_oldest(nwrite);
+        } else {
+            drop = true;
+        }
+        break;
+    }
 
     if (run_status != RunStatus::streaming) {
         return;
     }
 
-    uint64_t new_head = ring_buffer.head + numSamples;
-    size_t start = static_cast<size_t>(ring_buffer.head & RingBufferMask);
-    size_t end = static_cast<size_t>(new_head & RingBufferMask);
-    if (end > start || end == 0) {
-        // no wrap around - just one memcpy for I and Q
-        size_t memcpy_size = numSamples * sizeof(short);
-        std::memcpy(ring_buffer.xi + start, xi, memcpy_size);
-        std::memcpy(ring_buffer.xq + start, xq, memcpy_size);
-    } else {
-        // wrap around - two memcpy's for I and two for Q
-        size_t first = numSamples - end;
-        size_t memcpy_size_first = first * sizeof(short);
-        size_t memcpy_size_rest = end * sizeof(short);
-        std::memcpy(ring_buffer.xi + start, xi, memcpy_size_first);
-        std::memcpy(ring_buffer.xi, xi + first, memcpy_size_rest);
-        std::memcpy(ring_buffer.xq + start, xq, memcpy_size_first);
-        std::memcpy(ring_buffer.xq, xq + first, memcpy_size_rest);
+    uint64_t head = ring_buffer.write_index();
+    uint64_t new_head = head + nwrite;
+
+    if (dropped_oldest > 0) {
+        // the first sample after the discontinuity is the new tail
+        dropped_samples[stream_index].fetch_add(dropped_oldest, std::memory_order_relaxed);
+        struct param_change pc{};
+        pc.offset = new_head - ring_buffer.size;
+        pc.pctype = pct_overflow;
+        pc.dropped = pending_overflow[stream_index] + dropped_oldest;
+        push_param_change(stream_index, pc);
+        pending_overflow[stream_index] = 0;
+        if (time_tags) {
+            add_time_tag(stream_index, new_head - ring_buffer.size,
+                         sample_num + numSamples - ring_buffer.size);
+        }
     }
-    ring_buffer.head = new_head;
 
+    // queue the parameter changes before publishing the new samples, so
+    // work() always finds the tags for the samples it reads
+    // (if these samples are dropped, the changes apply to the next ones)
+    bool overloaded = overload[stream_index].load(std::memory_order_relaxed);
+    if (overloaded != overload_reported[stream_index]) {
+        overload_reported[stream_index] = overloaded;
+        if (overloaded)
+            stream_stats::add(st.overloads, 1);
+        if (stream_tags) {
+            struct param_change pc{};
+            pc.offset = head;
+            pc.pctype = pct_overload;
+            pc.overload = overloaded;
+            push_param_change(stream_index, pc);
+        }
+    }
     if (stream_tags) {
         if (params->fsChanged) {
-            struct param_change pc = {.offset=start, .pctype=pct_rate,
-                                      .rate=sample_rate};
-            std::unique_lock<std::mutex> lock(param_change_mutex[stream_index]);
-            param_changes[stream_index].push(pc);
+            struct param_change pc{};
+            pc.offset = head;
+            pc.pctype = pct_rate;
+            pc.rate = sample_rate;
+            push_param_change(stream_index, pc);
         }
         if (params->rfChanged) {
             double freq = rx_params->tunerParams.rfFreq.rfHz;
-            struct param_change pc = {.offset=start, .pctype=pct_freq,
-                                      .freq=freq};
-            std::unique_lock<std::mutex> lock(param_change_mutex[stream_index]);
-            param_changes[stream_index].push(pc);
+            struct param_change pc{};
+            pc.offset = head;
+            pc.pctype = pct_freq;
+            pc.freq = freq;
+            push_param_change(stream_index, pc);
+        }
+        if (gain_tag_policy_changed[stream_index].exchange(false, std::memory_order_relaxed)) {
+            GainTagPolicy policy = gain_tag_policy;
+            double value = policy == GainTagPolicy::gtp_interval ? gain_tag_interval :
+                           policy == GainTagPolicy::gtp_threshold ? gain_tag_threshold : 0;
+            struct param_change pc{};
+            pc.offset = head;
+            pc.pctype = pct_gain_tag_policy;
+            pc.gain_tag_policy.policy = policy;
+            pc.gain_tag_policy.value = value;
+            push_param_change(stream_index, pc);
+            // the next change is always tagged with the new policy
+            gain_tags[stream_index].valid = false;
+            gain_tags[stream_index].pending = false;
+        }
+        if (params->grChanged || gain_tags[stream_index].pending) {
+            add_gain_tag(stream_index, head,
+                         rx_params->tunerParams.gain.LNAstate,
+                         rx_params->tunerParams.gain.gRdB,
+                         params->grChanged);
+        }
+    }
+
+    int timed_changes = (params->fsChanged ? tcc_rate : 0) |
+                        (params->rfChanged ? tcc_freq : 0) |
+                        (params->grChanged ? tcc_gains : 0);
+    bool agc_on = rx_params->ctrlParams.agc.enable != sdrplay_api_AGC_DISABLE;
+
+    if (drop) {
+        // the changes in this packet can still be the boundary of a timed
+        // command, and the commands due must still be triggered; the next
+        // sample kept goes to head
+        if (stream_index == 0) {
+            process_timed_commands(head, sample_num + numSamples, 0, timed_changes,
+                                   agc_on);
+        }
+        time_tag_pending[stream_index] = true;
+        pending_overflow[stream_index] += numSamples;
+        // the gap before this packet is not filled either; it is added to
+        // the 'gap' tag of the next packet kept
+        if (sample_gaps_fill)
+            pending_gap[stream_index] += gap;
+        dropped_samples[stream_index].fetch_add(numSamples, std::memory_order_relaxed);
+        return;
+    }
+    if (pending_overflow[stream_index] > 0) {
+        // the first sample after the discontinuity is the first one of
+        // this packet
+        struct param_change pc{};
+        pc.offset = head;
+        pc.pctype = pct_overflow;
+        pc.dropped = pending_overflow[stream_index];
+        push_param_change(stream_index, pc);
+        pending_overflow[stream_index] = 0;
+    }
+    // only the gap right before this packet is filled with zeros; the
+    // missing samples include the gaps before the packets dropped
+    uint64_t missing = pending_gap[stream_index] + (nfill > 0 ? gap : 0);
+    if (missing > 0) {
+        struct param_change pc{};
+        pc.offset = head;
+        pc.pctype = pct_gap;
+        pc.missing = missing;
+        push_param_change(stream_index, pc);
+        pending_gap[stream_index] = 0;
+    }
+    if (nfill > 0) {
+        ring_buffer.write_zeros(head, nfill);
+    }
+    if (pending_settling_zero[stream_index]) {
+        // the samples zeroed from here on (the settling time may have
+        // started in the packets dropped)
+        uint64_t zeroed = nblank + settling_left[stream_index];
+        if (zeroed > 0) {
+            struct param_change pc{};
+            pc.offset = head + nfill;
+            pc.pctype = pct_settling;
+            pc.settling = zeroed;
+            push_param_change(stream_index, pc);
         }
-        if (params->grChanged) {
-            int lna_state = rx_params->tunerParams.gain.LNAstate;
-            int gRdB = rx_params->tunerParams.gain.gRdB;
-            struct param_change pc = {.offset=start, .pctype=pct_gains,
-                                      .gains={lna_state, gRdB}};
-            std::unique_lock<std::mutex> lock(param_change_mutex[stream_index]);
-            param_changes[stream_index].push(pc);
+        pending_settling_zero[stream_index] = false;
+    }
+    if (pending_settling[stream_index] > 0 && numSamples > 0) {
+        struct param_change pc{};
+        pc.offset = head + nfill;
+        pc.pctype = pct_settling;
+        pc.settling = pending_settling[stream_index];
+        push_param_change(stream_index, pc);
+        pending_settling[stream_index] = 0;
+    }
+    // on the first sample kept (the whole packet may have been dropped)
+    if (numSamples > 0) {
+        if (time_tags && time_tag_pending[stream_index]) {
+            add_time_tag(stream_index, head + nfill, sample_num);
         }
+        time_tag_pending[stream_index] = false;
     }
+    if (output_type == OutputType::sc8) {
+        sc8_update_shift(stream_index, head + nfill, xi, xq, numSamples);
+    }
+    if (stream_index == 0) {
+        process_timed_commands(head + nfill, sample_num, numSamples, timed_changes,
+                               agc_on);
+    }
+    if (nblank > 0) {
+        ring_buffer.write_zeros(head + nfill, nblank);
+        nfill += nblank;
+        xi += nblank;
+        xq += nblank;
+        numSamples -= nblank;
+    }
+    // only the samples written (not the dropped or blanked ones)
+    if (overloaded)
+        stream_stats::add(st.overload_samples, numSamples);
+
+    // straight to the output buffer of work() if it is waiting for these
+    // samples, the rest to the ring buffer
+    char *handoff_out[ring_buffer::MaxPlanes];
+    unsigned int nhandoff = ring_buffer.take_handoff(head + nfill, numSamples,
+                                                     handoff_out);
+    if (nhandoff > 0) {
+        convert_samples(stream_index, xi, xq, handoff_out[0],
+                        split_iq ? handoff_out[1] : nullptr, nhandoff);
+        ring_buffer.complete_handoff();
+        stream_stats::add(st.handoff_samples, nhandoff);
+    }
+    ring_buffer.write(head + nfill + nhandoff, numSamples - nhandoff,
+                      [this, stream_index, xi, xq, nhandoff, &ring_buffer](char *out, size_t offset, size_t count) {
+                          offset += nhandoff;
+                          convert_samples(stream_index, xi + offset, xq + offset,
+                                          out, split_iq ? out + ring_buffer.plane_stride : nullptr,
+                                          count);
+                      });
 
-    ring_buffer.empty.notify_one();
+    ring_buffer.commit_write(new_head);
+    stream_stats::max(st.ring_fill_max, new_head - ring_buffer.read_index());
 
     return;
 }
 
+// settling time calibration
+void rsp_impl::measure_settling(int stream_index, const short *xi,
+                                const short *xq, unsigned int numSamples)
+{
+    auto& m = settling_measurements[stream_index];
+    for (unsigned int i = 0; i < numSamples; i++) {
+        m.power += static_cast<double>(xi[i]) * xi[i] +
+                   static_cast<double>(xq[i]) * xq[i];
+        if (++m.count < m.window)
+            continue;
+        m.powers[m.nwindows % SettlingWindows] = m.power / m.window;
+        m.nwindows++;
+        m.count = 0;
+        m.power = 0;
+        bool settled = false;
+        if (m.nwindows >= SettlingWindows) {
+            auto minmax = std::minmax_element(std::begin(m.powers), std::end(m.powers));
+            settled = *minmax.second <= *minmax.first * SettlingTolerance;
+        }
+        double elapsed = m.nwindows * m.window / sample_rate;
+        if (!settled && elapsed < SettlingMaxTime)
+            continue;
+
+        // the transient ends where the stable windows start
+        double settling_time = settled ?
+            (m.nwindows - SettlingWindows) * m.window / sample_rate * 1e6 :
+            SettlingMaxTime * 1e6;
+        if (!settled)
+            d_logger->warn("settling time calibration - the power did not settle within {:.0f}ms",
+                           SettlingMaxTime * 1e3);
+        d_logger->info("settling time calibration - band={} settling_time={:.0f}us", m.band, settling_time);
+        if (!settling_measured[m.band].exchange(true, std::memory_order_relaxed) ||
+            settling_time > settling_times[m.band].load(std::memory_order_relaxed))
+            settling_times[m.band].store(settling_time, std::memory_order_relaxed);
+        m.active = false;
+        return;
+    }
+}
+
+// timed commands
+void rsp_impl::handle_command_message(const pmt::pmt_t& msg)
+{
+    if (pmt::is_dict(msg) && pmt::dict_has_key(msg, COMMAND_TIME_KEY)) {
+        queue_timed_command(msg);
+        return;
+    }
+    std::lock_guard<std::mutex> lock(handle_command_mutex);
+    handle_command(msg);
+}
+
+void rsp_impl::queue_timed_command(const pmt::pmt_t& msg)
+{
+    pmt::pmt_t time = pmt::dict_ref(msg, COMMAND_TIME_KEY, pmt::PMT_NIL);
+    struct timed_command tc = {};
+    if (pmt::is_integer(time) || pmt::is_uint64(time)) {
+        tc.at_sample = true;
+        tc.sample_index = pmt::to_uint64(time);
+    } else if (pmt::is_tuple(time) && pmt::length(time) == 2 &&
+               pmt::is_uint64(pmt::tuple_ref(time, 0)) &&
+               pmt::is_real(pmt::tuple_ref(time, 1))) {
+        tc.at_sample = false;
+        tc.full_secs = pmt::to_uint64(pmt::tuple_ref(time, 0));
+        tc.frac_secs = pmt::to_double(pmt::tuple_ref(time, 1));
+    } else {
+        d_logger->alert("Invalid command time: {}", pmt::write_string(time));
+        return;
+    }
+    pmt::pmt_t command = pmt::dict_delete(msg, COMMAND_TIME_KEY);
+    if (pmt::dict_has_key(command, pmt::mp("rate")))
+        tc.changes |= tcc_rate;
+    if (pmt::dict_has_key(command, pmt::mp("freq")))
+        tc.changes |= tcc_freq;
+    if (pmt::dict_has_key(command, pmt::mp("if_gain")) ||
+        pmt::dict_has_key(command, pmt::mp("rf_gain")) ||
+        pmt::dict_has_key(command, pmt::mp("lna_state")))
+        tc.changes |= tcc_gains;
+    tc.id = ++timed_command_id;
+
+    std::lock_guard<std::mutex> lock(command_mutex);
+    if (!timed_commands_new.push(tc)) {
+        d_logger->error("too many timed commands - command dropped: {}", pmt::write_string(msg));
+        return;
+    }
+    timed_command_msgs[tc.id] = command;
+    // the 'timed_command' tags need the tags path in work()
+    if (!timed_commands_queued) {
+        timed_commands_queued = true;
+        select_work_function();
+    }
+}
+
+void rsp_impl::process_timed_commands(uint64_t index, uint64_t sample_num,
+                                      unsigned int numSamples, int changes,
+                                      bool agc)
+{
+    timed_commands_new.drain([&](const struct timed_command &tc) {
+        if (timed_schedule.size() == MaxTimedCommands)
+            return false;
+        uint64_t target = tc.sample_index;
+        if (!tc.at_sample) {
+            // sample numbers and ring buffer indexes differ by a constant
+            // (within this packet)
+            int64_t delta = static_cast<int64_t>(
+                clock_models[0].sample_num_at(tc.full_secs, tc.frac_secs) - sample_num);
+            target = delta > -static_cast<int64_t>(index) ? index + delta : 0;
+        }
+        struct scheduled_command sc{};
+        sc.id = tc.id;
+        sc.index = target;
+        sc.changes = tc.changes;
+        sc.state = tcs_scheduled;
+        sc.trigger_index = 0;
+        auto pos = std::upper_bound(timed_schedule.begin(), timed_schedule.end(), sc,
+                                    [](const scheduled_command& a, const scheduled_command& b) {
+                                        return a.index < b.index;
+                                    });
+        timed_schedule.insert(pos, sc);
+        return true;
+    });
+    if (timed_schedule.empty())
+        return;
+    timed_commands_done.drain([&](const uint64_t& id) {
+        for (auto& sc : timed_schedule) {
+            if (sc.id == id)
+                sc.state = tcs_executed;
+        }
+        return true;
+    });
+
+    uint64_t end = index + numSamples;
+    uint64_t timeout = static_cast<uint64_t>(sample_rate *
+        std::chrono::duration<double>(update_timeout).count());
+    bool due = false;
+    for (auto it = timed_schedule.begin(); it != timed_schedule.end();) {
+        auto& sc = *it;
+        bool done = false;
+        bool measured = false;
+        if (sc.state == tcs_scheduled) {
+            // the update is issued at the end of this packet or the next
+            // one; pick the one that lands the change closer to the target
+            if (end + static_cast<uint64_t>(timed_command_latency) + numSamples / 2 >= sc.index) {
+                if (timed_commands_due.push(sc.id)) {
+                    sc.state = tcs_due;
+                    sc.trigger_index = end;
+                    due = true;
+                }
+            }
+        } else if (sc.state == tcs_executed) {
+            // with the AGC on, the gain changes cannot be told apart from
+            // the ones made by the AGC
+            int expected = agc ? sc.changes & ~tcc_gains : sc.changes;
+            if (expected & changes) {
+                // the first change of the expected kind after the update
+                // is the boundary
+                done = measured = true;
+                timed_command_latency += (static_cast<double>(index - sc.trigger_index) -
+                                          timed_command_latency) / 4;
+            } else {
+                // no change expected, no change that can be measured, or
+                // none reported (for instance the same frequency again)
+                done = expected == 0 || index - sc.trigger_index > timeout;
+                measured = sc.changes == 0;
+            }
+        }
+        if (!done) {
+            ++it;
+            continue;
+        }
+        struct param_change pc{};
+        pc.offset = index;
+        pc.pctype = pct_timed_command;
+        pc.timed_command.index = sc.index;
+        pc.timed_command.error = static_cast<int64_t>(index - sc.index);
+        pc.timed_command.measured = measured;
+        push_param_change(0, pc);
+        it = timed_schedule.erase(it);
+    }
+    if (due) {
+        { std::lock_guard<std::mutex> lock(command_mutex); }
+        command_cv.notify_one();
+    }
+}
+
+void rsp_impl::command_loop()
+{
+    std::unique_lock<std::mutex> lock(command_mutex);
+    std::vector<uint64_t> due;
+    while (!command_stop) {
+        due.clear();
+        timed_commands_due.drain([&due](const uint64_t& id) {
+            due.push_back(id);
+            return true;
+        });
+        if (due.empty()) {
+            command_cv.wait(lock);
+            continue;
+        }
+        for (uint64_t id : due) {
+            auto it = timed_command_msgs.find(id);
+            if (it != timed_command_msgs.end()) {
+                pmt::pmt_t command = it->second;
+                timed_command_msgs.erase(it);
+                lock.unlock();
+                {
+                    std::lock_guard<std::mutex> command_lock(handle_command_mutex);
+                    handle_command(command);
+                }
+                lock.lock();
+            }
+            timed_commands_done.push(id);
+        }
+    }
+}
+
+void rsp_impl::start_command_thread()
+{
+    stop_command_thread();
+    command_stop = false;
+    command_thread = std::thread(&rsp_impl::command_loop, this);
+}
+
+void rsp_impl::stop_command_thread()
+{
+    {
+        std::lock_guard<std::mutex> lock(command_mutex);
+        command_stop = true;
+        command_cv.notify_all();
+    }
+    if (command_thread.joinable())
+        command_thread.join();
+}
+
+template <int Type, bool Split>
+void rsp_impl::convert_samples_as(int stream_index, const short *xi,
+                                  const short *xq, char *out, char *out_q,
+                                  size_t nsamples) const
+{
+    const sample_copy_kernels& kernels = get_sample_copy_kernels();
+    if constexpr (Split) {
+        // no interleaving: out is the I plane and out_q the Q plane
+        if constexpr (Type == OutputType::fc32) {
+            kernels.f32(xi, reinterpret_cast<float *>(out), nsamples);
+            kernels.f32(xq, reinterpret_cast<float *>(out_q), nsamples);
+        } else {
+            std::memcpy(out, xi, nsamples * sizeof(short));
+            std::memcpy(out_q, xq, nsamples * sizeof(short));
+        }
+    } else if constexpr (Type == OutputType::fc32) {
+        kernels.fc32(xi, xq, reinterpret_cast<gr_complex *>(out), nsamples);
+    } else if constexpr (Type == OutputType::sc16) {
+        kernels.sc16(xi, xq, reinterpret_cast<short (*)[2]>(out), nsamples);
+    } else if constexpr (Type == OutputType::sc8) {
+        kernels.sc8(xi, xq, reinterpret_cast<signed char (*)[2]>(out), nsamples,
+                    sc8_shift[stream_index]);
+    } else if constexpr (Type == OutputType::sc12) {
+        kernels.sc12(xi, xq, reinterpret_cast<unsigned char (*)[3]>(out), nsamples);
+    } else if constexpr (Type == OutputType::fc16) {
+        kernels.fc16(xi, xq, reinterpret_cast<uint16_t (*)[2]>(out), nsamples);
+    }
+}
+
+void rsp_impl::select_convert_function()
+{
+    switch (output_type) {
+    case OutputType::fc32:
+        convert_fn = split_iq ? &rsp_impl::convert_samples_as<OutputType::fc32, true> :
+                                &rsp_impl::convert_samples_as<OutputType::fc32, false>;
+        break;
+    case OutputType::sc16:
+        convert_fn = split_iq ? &rsp_impl::convert_samples_as<OutputType::sc16, true> :
+                                &rsp_impl::convert_samples_as<OutputType::sc16, false>;
+        break;
+    case OutputType::sc8:
+        convert_fn = &rsp_impl::convert_samples_as<OutputType::sc8, false>;
+        break;
+    case OutputType::sc12:
+        convert_fn = &rsp_impl::convert_samples_as<OutputType::sc12, false>;
+        break;
+    case OutputType::fc16:
+        convert_fn = &rsp_impl::convert_samples_as<OutputType::fc16, false>;
+        break;
+    }
+}
+
+void rsp_impl::sc8_update_shift(int stream_index, uint64_t offset,
+                                const short *xi, const short *xq,
+                                unsigned int nsamples)
+{
+    int shift = sc8_shift_setting;
+    if (shift < 0) {
+        float peak = static_cast<float>(get_sample_copy_kernels().peak(xi, xq, nsamples));
+        float decay = static_cast<float>(std::exp(-nsamples / (sample_rate * Sc8PeakDecay)));
+        sc8_peak[stream_index] = std::max(peak, sc8_peak[stream_index] * decay);
+        shift = 0;
+        while (shift < 8 && sc8_peak[stream_index] >= (128 << shift))
+            shift++;
+    }
+    if (shift == sc8_shift[stream_index])
+        return;
+    sc8_shift[stream_index] = shift;
+    struct param_change pc{};
+    pc.offset = offset;
+    pc.pctype = pct_scale;
+    pc.scale = static_cast<double>(1 << shift);
+    push_param_change(stream_index, pc);
+}
+
+void rsp_impl::add_gain_tag(int stream_index, uint64_t offset, int lna_state,
+                            int gRdB, bool changed)
+{
+    gain_tag_state& last = gain_tags[stream_index];
+    switch (gain_tag_policy) {
+    case GainTagPolicy::gtp_all:
+        if (!changed)
+            return;
+        break;
+    case GainTagPolicy::gtp_interval:
+        // too soon - tag the latest gains once the interval is over
+        if (last.valid && offset - last.offset < gain_tag_interval) {
+            last.pending = true;
+            return;
+        }
+        break;
+    case GainTagPolicy::gtp_threshold:
+        if (!changed)
+            return;
+        // small steps are compared with the last value tagged, so a slow
+        // drift is tagged eventually
+        if (last.valid && lna_state == last.lna_state &&
+            std::abs(gRdB - last.gRdB) <= gain_tag_threshold)
+            return;
+        break;
+    }
+    struct param_change pc{};
+    pc.offset = offset;
+    pc.pctype = pct_gains;
+    pc.gains[0] = lna_state;
+    pc.gains[1] = gRdB;
+    push_param_change(stream_index, pc);
+    last.valid = true;
+    last.pending = false;
+    last.offset = offset;
+    last.lna_state = lna_state;
+    last.gRdB = gRdB;
+}
+
+void rsp_impl::add_time_tag(int stream_index, uint64_t offset,
+                            uint64_t sample_num)
+{
+    struct param_change pc{};
+    pc.offset = offset;
+    pc.pctype = pct_time;
+    clock_models[stream_index].time_of(sample_num, pc.time.full_secs,
+                                       pc.time.frac_secs);
+    push_param_change(stream_index, pc);
+}
+
 void rsp_impl::event_callback(sdrplay_api_EventT eventId,
                               sdrplay_api_TunerSelectT tuner,
                               sdrplay_api_EventParamsT *params)
 {
     switch (eventId) {
     case sdrplay_api_GainChange:
-        if (show_gain_changes) {
+        if (show_gain_changes && gain_log_due(&params->gainParams)) {
             sdrplay_api_GainCbParamT *gainParams = &params->gainParams;
             d_logger->info("gain change - gRdB={} lnaGRdB={} currGain={:.2f}", gainParams->gRdB, gainParams->lnaGRdB, gainParams->currGain);
         }
@@ -902,14 +1968,21 @@ void rsp_impl::event_callback(sdrplay_api_EventT eventId,
     case sdrplay_api_PowerOverloadChange:
         // send ack back for overload events
         if (run_status == RunStatus::streaming) {
+            bool overloaded = false;
             switch (params->powerOverloadParams.powerOverloadChangeType) {
             case sdrplay_api_Overload_Detected:
                 d_logger->warn("overload detected - please reduce gain");
+                overloaded = true;
                 break;
             case sdrplay_api_Overload_Corrected:
                 d_logger->warn("overload corrected");
                 break;
             }
+            // tuner B is stream 1 only when both tuners are streaming
+            if (nchannels == 1 || tuner != sdrplay_api_Tuner_B)
+                overload[0].store(overloaded, std::memory_order_relaxed);
+            if (nchannels == 2 && tuner != sdrplay_api_Tuner_A)
+                overload[1].store(overloaded, std::memory_order_relaxed);
             sdrplay_api_Update(device.dev, device.tuner,
                                sdrplay_api_Update_Ctrl_OverloadMsgAck,
                                sdrplay_api_Update_Ext1_None);
@@ -942,11 +2015,53 @@ void rsp_impl::set_sample_sequence_gaps_check(bool enable)
     sample_sequence_gaps_check = enable;
 }
 
+void rsp_impl::set_sample_gaps_fill(bool enable)
+{
+    sample_gaps_fill = enable;
+    select_work_function();
+}
+
+std::pair<uint64_t, uint64_t> rsp_impl::get_sample_gaps(int stream_index) const
+{
+    if (stream_index < 0 || stream_index > 1) {
+        d_logger->error("invalid stream index: {}", stream_index);
+        return std::make_pair(0, 0);
+    }
+    return std::make_pair(sample_gaps_count[stream_index].load(std::memory_order_relaxed),
+                          sample_gaps_missing[stream_index].load(std::memory_order_relaxed));
+}
+
 void rsp_impl::set_show_gain_changes(bool enable)
 {
     show_gain_changes = enable;
 }
 
+// limit the gain change messages like the 'gains' tags (the latest
+// gains are not logged at the end of an interval though)
+bool rsp_impl::gain_log_due(const sdrplay_api_GainCbParamT *gainParams)
+{
+    auto now = std::chrono::steady_clock::now();
+    switch (gain_tag_policy) {
+    case GainTagPolicy::gtp_all:
+        break;
+    case GainTagPolicy::gtp_interval:
+        if (gain_log.valid && sample_rate > 0 &&
+            std::chrono::duration<double>(now - gain_log.time).count() < gain_tag_interval / sample_rate)
+            return false;
+        break;
+    case GainTagPolicy::gtp_threshold:
+        if (gain_log.valid && gainParams->lnaGRdB == gain_log.lnaGRdB &&
+            std::abs(static_cast<int>(gainParams->gRdB - gain_log.gRdB)) <= gain_tag_threshold)
+            return false;
+        break;
+    }
+    gain_log.valid = true;
+    gain_log.time = now;
+    gain_log.gRdB = gainParams->gRdB;
+    gain_log.lnaGRdB = gainParams->lnaGRdB;
+    return true;
+}
+
 
 // internal methods
 bool rsp_impl::rsp_select(const unsigned char hwVer, const std::string& selector)
@@ -1222,23 +2337,21 @@ void rsp_impl::print_device_config() const
     return;
 }
 
-void sample_gaps_check(unsigned int num_samples, unsigned int first_sample_num,
-                       unsigned int& next_sample_num,
+void sample_gaps_check(unsigned int num_samples, uint64_t first_sample_num,
+                       uint64_t next_sample_num,
                        gr::logger_ptr logger, int stream_index)
 {
-    if (next_sample_num != 0 && next_sample_num != first_sample_num) {
-        unsigned int sample_num_gap;
-        if (next_sample_num < first_sample_num) {
-            sample_num_gap = first_sample_num - next_sample_num;
-        } else {
-            sample_num_gap = UINT_MAX - (first_sample_num - next_sample_num) + 1;
-        }
+    if (first_sample_num > next_sample_num) {
+        uint64_t sample_num_gap = first_sample_num - next_sample_num;
         logger->warn("sample num gap in stream {}: {} [{}:{}] -> {}+{}",
                      stream_index, sample_num_gap, next_sample_num,
                      first_sample_num, sample_num_gap / num_samples,
                      sample_num_gap % num_samples);
+    } else {
+        logger->warn("sample num went back in stream {}: {} [{}:{}]",
+                     stream_index, next_sample_num - first_sample_num,
+                     next_sample_num, first_sample_num);
     }
-    next_sample_num = first_sample_num + num_samples;
 }
 
 } /* namespace sdrplay3 */
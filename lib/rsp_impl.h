@@ -9,9 +9,18 @@
 #define INCLUDED_SDRPLAY3_RSP_IMPL_H
 
 #include <gnuradio/sdrplay3/rsp.h>
+#include <gnuradio/buffer.h>
 #include <sdrplay_api.h>
+#include <algorithm>
+#include <atomic>
 #include <condition_variable>
-#include <queue>
+#include <map>
+#include <thread>
+#include <vector>
+#include "clock_model.h"
+#include "ring_buffer.h"
+#include "spsc_queue.h"
+#include "stream_stats.h"
 
 namespace gr {
 namespace sdrplay3 {
@@ -72,10 +81,39 @@ public:
 
     // Stream tags
     void set_stream_tags(bool enable) override;
+    void set_time_tags(bool enable) override;
+    void set_gain_tag_policy(const std::string& policy,
+                             const double value = 0) override;
+    double get_clock_drift_ppm(int stream_index = 0) const override;
+
+    // Overflow policy
+    void set_overflow_policy(const std::string& policy) override;
+    uint64_t get_dropped_samples(int stream_index = 0) const override;
+
+    // sc8 output scaling
+    void set_sc8_shift(int shift) override;
+
+    // Batched wake ups
+    void set_low_water_mark(const double low_water_mark,
+                            const std::string& units = "samples") override;
+    void set_max_latency(const double max_latency) override;
+    void set_direct_handoff(bool enable) override;
+    void set_settling(const std::string& mode,
+                      const double settling_time = -1) override;
+    void set_band_settling_time(const double freq,
+                                const double settling_time) override;
+    double get_band_settling_time(const double freq) const override;
+    void set_settling_calibration(bool enable) override;
 
     // Debug methods
     void set_debug_mode(bool enable) override;
     void set_sample_sequence_gaps_check(bool enable) override;
+    void set_sample_gaps_fill(bool enable) override;
+    std::pair<uint64_t, uint64_t> get_sample_gaps(int stream_index = 0) const override;
+
+    // Statistics
+    pmt::pmt_t get_stats() const override;
+    void set_status_interval(const double interval) override;
     void set_show_gain_changes(bool enable) override;
 
 protected:
@@ -118,8 +156,7 @@ protected:
     virtual const std::vector<int> rf_gr_values() const = 0;
 
     bool start_api_init();
-    void add_stream_tags(size_t start, size_t end, int noutput_items,
-                         int stream_index);
+    void add_stream_tags(uint64_t start, int noutput_items, int stream_index);
 
     // callback functions
     virtual void event_callback(sdrplay_api_EventT eventId,
@@ -153,19 +190,89 @@ private:
                          int stream_index,
                          sdrplay_api_RxChannelParamsT *rx_channel);
 
-    // ring buffers to transfer data from the stream callbacks to work()
-    // RingBufferSize must be a power of 2 to simplify wrap-around
-    constexpr static unsigned int RingBufferSize = 65536;
-    constexpr static unsigned int RingBufferMask = RingBufferSize - 1;
-    struct {
-        short* xi;
-        short* xq;
-        uint64_t head;
-        uint64_t tail;
-        std::condition_variable empty;
-        std::condition_variable overflow;
-        std::mutex mtx;
-    } ring_buffers[2];
+    // lock-free ring buffers to transfer data from the stream callbacks
+    // to work(); the samples are converted to the output type in the stream
+    // callbacks, so work() only needs to copy them
+    // ring_buffer_size must be a power of 2 to simplify wrap-around
+    constexpr static unsigned int MinRingBufferSize = 16384;
+    constexpr static unsigned int MaxRingBufferSize = 1 << 26;
+    unsigned int ring_buffer_size;
+    bool ring_buffer_huge_pages;
+    ring_buffer ring_buffers[2];
+
+    // conversion to the output type, specialized for each output type and
+    // layout; selected in start() (the output type does not change while
+    // streaming)
+    typedef void (rsp_impl::*convert_function)(int stream_index, const short *xi,
+                                               const short *xq, char *out,
+                                               char *out_q, size_t nsamples) const;
+    convert_function convert_fn;
+    template <int Type, bool Split>     // Type is an OutputType
+    void convert_samples_as(int stream_index, const short *xi, const short *xq,
+                            char *out, char *out_q, size_t nsamples) const;
+    void select_convert_function();
+    void convert_samples(int stream_index, const short *xi, const short *xq,
+                         char *out, char *out_q, size_t nsamples) const
+    {
+        (this->*convert_fn)(stream_index, xi, xq, out, out_q, nsamples);
+    }
+
+    // work() hot path, specialized for the number of streams and planes and
+    // for stream tags on/off; selected in start() and again whenever a
+    // setting that affects the stream tags changes (hence a plain function
+    // pointer, which can be swapped atomically)
+    // (max_samples, min_samples and granularity are in samples)
+    typedef int (*work_function)(rsp_impl *rsp, uint64_t max_samples,
+                                 gr_vector_void_star& output_items,
+                                 uint64_t min_samples, uint64_t granularity,
+                                 bool handoff);
+    std::atomic<work_function> work_fn;
+    template <int NStreams, int NPlanes, bool Tags>
+    int work_streams(uint64_t max_samples, gr_vector_void_star& output_items,
+                     uint64_t min_samples, uint64_t granularity, bool handoff);
+    template <int NStreams, int NPlanes, bool Tags>
+    static int work_streams_fn(rsp_impl *rsp, uint64_t max_samples,
+                               gr_vector_void_star& output_items,
+                               uint64_t min_samples, uint64_t granularity,
+                               bool handoff)
+    {
+        return rsp->work_streams<NStreams, NPlanes, Tags>(
+            max_samples, output_items, min_samples, granularity, handoff);
+    }
+    template <int NStreams, int NPlanes>
+    static work_function work_function_for(bool tags);
+    void select_work_function();
+
+    // split I/Q: each stream goes to two output ports (I and Q); the ring
+    // buffers keep them in two planes
+    bool split_iq;
+    int first_port(int stream_index) const { return split_iq ? 2 * stream_index : stream_index; }
+    int ports_per_stream() const { return split_iq ? 2 : 1; }
+
+    // each output item is a vector of vector_length samples; the ring
+    // buffers (and the stream tags offsets) still count samples
+    unsigned int vector_length;
+
+    // what to do in the stream callback when the ring buffer is full
+    enum OverflowPolicy {op_block=0, op_drop_newest=1, op_drop_oldest=2};
+    OverflowPolicy overflow_policy;
+    std::atomic<uint64_t> dropped_samples[2];
+    // samples dropped by drop_newest not reported in an overflow tag yet
+    // (only used by the stream callbacks)
+    uint64_t pending_overflow[2];
+    // samples missing (sequence gaps) before the packets dropped, for the
+    // 'gap' tag of the next packet kept (only used by the stream callbacks)
+    uint64_t pending_gap[2];
+
+    // wake up work() only when this much data is available (or after
+    // max_latency)
+    double low_water_mark;
+    bool low_water_mark_in_us;
+    std::chrono::microseconds max_latency;
+
+    // let the stream callbacks write directly to the output buffers of a
+    // waiting work() (see ring_buffer)
+    bool direct_handoff;
 
     // changes to sample rate, fequency, and gain reduction reported by
     // RX callback
@@ -180,22 +287,213 @@ private:
 
     // param changes as stream tags
     bool stream_tags;
-    enum ParamChangeType {pct_rate=1, pct_freq=2, pct_gains=3};
+    enum ParamChangeType {pct_rate=1, pct_freq=2, pct_gains=3, pct_overflow=4,
+                          pct_time=5, pct_gap=6, pct_scale=7,
+                          pct_gain_tag_policy=8, pct_overload=9,
+                          pct_timed_command=10, pct_settling=11};
     struct param_change {
-        unsigned long offset;
+        uint64_t offset;    // absolute sample index in the ring buffer
         enum ParamChangeType pctype;
         union {
             double rate;
             double freq;
             int gains[2];
+            uint64_t dropped;
+            uint64_t missing;
+            double scale;
+            bool overload;
+            uint64_t settling;
+            struct {
+                uint64_t full_secs;
+                double frac_secs;
+            } time;
+            struct {
+                int policy;
+                double value;
+            } gain_tag_policy;
+            struct {
+                uint64_t index;     // requested sample index
+                int64_t error;      // in samples (positive if late)
+                bool measured;
+            } timed_command;
         };
     };
-    std::queue<struct param_change> param_changes[2];
-    std::mutex param_change_mutex[2];
+    // lock-free queues from the stream callbacks to work(), drained in one
+    // batch per work() call; sized for a full ring buffer of short packets
+    // with a few changes each, within limits (if one fills up, the changes
+    // are dropped and counted in the stats)
+    constexpr static size_t MinParamChanges = 1024;
+    constexpr static size_t MaxParamChanges = 65536;
+    size_t param_change_queue_size() const
+    {
+        return std::min(std::max<size_t>(ring_buffer_size / 64, MinParamChanges),
+                        MaxParamChanges);
+    }
+    spsc_queue<struct param_change> param_changes[2];
+    // changes taken from the queues for the samples not read yet, sorted
+    // by offset (only used by work())
+    std::vector<struct param_change> pending_changes[2];
+    void push_param_change(int stream_index, const struct param_change& pc);
+
+    // which IF gain changes (from AGC) become 'gains' tags
+    enum GainTagPolicy {gtp_all=0, gtp_interval=1, gtp_threshold=2};
+    GainTagPolicy gain_tag_policy;
+    uint64_t gain_tag_interval;         // in samples
+    double gain_tag_threshold;          // in dB
+    // set when the policy changes, cleared by the stream callback once the
+    // 'gain_tag_policy' tag is queued
+    std::atomic<bool> gain_tag_policy_changed[2];
+    // last 'gains' tag (only used by the stream callbacks)
+    struct gain_tag_state {
+        bool valid;
+        bool pending;                   // a change is waiting for the interval
+        uint64_t offset;
+        int lna_state;
+        int gRdB;
+    };
+    gain_tag_state gain_tags[2];
+    void add_gain_tag(int stream_index, uint64_t offset, int lna_state,
+                      int gRdB, bool changed);
+    // same policy for the gain change messages (only used by the event
+    // callback)
+    struct {
+        bool valid;
+        std::chrono::steady_clock::time_point time;
+        unsigned int gRdB;
+        unsigned int lnaGRdB;
+    } gain_log;
+    bool gain_log_due(const sdrplay_api_GainCbParamT *gainParams);
+
+    // power overload state from the event callback, tagged 'overload' by
+    // the stream callback on the first sample of the next packet
+    std::atomic<bool> overload[2];
+    bool overload_reported[2];          // only used by the stream callbacks
+
+    // blanking of the settling transients after a retune or a gain change,
+    // with a settling time (in us) for each front end band
+    enum SettlingMode {sm_off=0, sm_zero=1, sm_drop=2};
+    SettlingMode settling_mode;
+    constexpr static int NSettlingBands = 8;
+    constexpr static double DefaultSettlingTime = 1000;  // in us
+    static int settling_band(double freq);
+    std::atomic<double> settling_times[NSettlingBands];
+    // calibration: the longest settling time measured in each band since
+    // the calibration was enabled
+    bool settling_calibration;
+    std::atomic<bool> settling_measured[NSettlingBands];
+    // only used by the stream callbacks
+    uint64_t settling_left[2];          // samples still to blank
+    uint64_t pending_settling[2];       // samples dropped not tagged yet
+    bool pending_settling_zero[2];      // zeroed samples not tagged yet
+    // the transient is over when the power of SettlingWindows consecutive
+    // windows is within SettlingTolerance
+    constexpr static int SettlingWindows = 8;
+    constexpr static double SettlingTolerance = 1.585;  // 2 dB
+    constexpr static double SettlingMaxTime = 0.1;      // in seconds
+    struct settling_measurement {
+        bool active;
+        int band;
+        unsigned int window;            // in samples
+        unsigned int count;             // samples in the current window
+        double power;                   // sum for the current window
+        uint64_t nwindows;
+        double powers[SettlingWindows]; // of the last windows
+    };
+    settling_measurement settling_measurements[2];
+    void measure_settling(int stream_index, const short *xi, const short *xq,
+                          unsigned int numSamples);
+
+    // rx_time tags computed from the sample numbers and a model of the
+    // sample clock vs. the host clock (only used by the stream callbacks,
+    // except for the drift)
+    bool time_tags;
+    clock_model clock_models[2];
+    bool sample_num_valid[2];
+    uint64_t next_sample_num[2];    // unwrapped firstSampleNum
+    bool time_tag_pending[2];
+    void add_time_tag(int stream_index, uint64_t offset, uint64_t sample_num);
+
+    // sc8 output: the samples are shifted right by a fixed number of bits,
+    // or by the smallest number of bits that keeps their running peak
+    // (which follows increases right away and decays with a time constant
+    // of Sc8PeakDecay seconds) in the int8 range
+    constexpr static double Sc8PeakDecay = 1.0;
+    int sc8_shift_setting;          // -1 = automatic
+    int sc8_shift[2];               // current shift (-1 = not tagged yet)
+    float sc8_peak[2];
+    void sc8_update_shift(int stream_index, uint64_t offset, const short *xi,
+                          const short *xq, unsigned int nsamples);
 
     bool sample_sequence_gaps_check;
+    // sample sequence gaps (per stream)
+    bool sample_gaps_fill;
+    std::atomic<uint64_t> sample_gaps_count[2];
+    std::atomic<uint64_t> sample_gaps_missing[2];
+
+    // statistics and periodic status messages
+    stream_stats stats[2];
+    std::chrono::duration<double> status_interval;
+    bool status_stop;
+    std::mutex status_mutex;
+    std::condition_variable status_cv;
+    std::thread status_thread;
+    void status_loop();
+    void start_status_thread();
+    void stop_status_thread();
     bool show_gain_changes;
 
+    // timed commands (command messages with a 'time' key): the stream
+    // callback of stream 0 knows the sample index, so it schedules them and
+    // measures where their changes land; the command thread executes them
+    // (the SDRplay API update calls can take a while)
+    enum TimedCommandChange {tcc_rate=1, tcc_freq=2, tcc_gains=4};
+    struct timed_command {
+        uint64_t id;
+        bool at_sample;                 // time is a sample index
+        uint64_t sample_index;
+        uint64_t full_secs;             // otherwise a UTC time
+        double frac_secs;
+        int changes;                    // TimedCommandChange flags expected
+    };
+    constexpr static size_t MaxTimedCommands = 256;
+    uint64_t timed_command_id;          // only used by the message handler
+    bool timed_commands_queued;         // since the block was created
+    std::map<uint64_t, pmt::pmt_t> timed_command_msgs;  // by id
+    // message handler -> stream callback
+    spsc_queue<timed_command> timed_commands_new;
+    // stream callback -> command thread (ids of the commands due)
+    spsc_queue<uint64_t> timed_commands_due;
+    // command thread -> stream callback (ids of the commands executed)
+    spsc_queue<uint64_t> timed_commands_done;
+    // schedule sorted by sample index (only used by the stream callback)
+    enum TimedCommandState {tcs_scheduled=0, tcs_due=1, tcs_executed=2};
+    struct scheduled_command {
+        uint64_t id;
+        uint64_t index;
+        int changes;
+        TimedCommandState state;
+        uint64_t trigger_index;         // end of the packet when it was due
+    };
+    std::vector<scheduled_command> timed_schedule;
+    // samples between the update call and the change in the stream,
+    // learned from the previous commands (only used by the stream callback)
+    double timed_command_latency;
+    bool command_stop;
+    std::mutex command_mutex;
+    std::condition_variable command_cv;
+    std::thread command_thread;
+    // the untimed commands (message handler) and the timed ones (command
+    // thread) change the same device parameters
+    std::mutex handle_command_mutex;
+    void handle_command_message(const pmt::pmt_t& msg);
+    void queue_timed_command(const pmt::pmt_t& msg);
+    void process_timed_commands(uint64_t index, uint64_t sample_num,
+                                unsigned int numSamples, int changes,
+                                bool agc);
+    void command_loop();
+    void start_command_thread();
+    void stop_command_thread();
+
 protected:
     sdrplay_api_DeviceT device;
     sdrplay_api_DeviceParamsT *device_params;
@@ -204,8 +502,9 @@ protected:
     enum RunStatus {idle=0, init=1, in_transition=2, streaming=3};
     RunStatus run_status;
     int nchannels;
-    enum OutputType {fc32=1, sc16=2};
+    enum OutputType {fc32=1, sc16=2, sc8=3, sc12=4, fc16=5};
     enum OutputType output_type;
+    size_t output_item_size;        // per sample and output port
 
     struct _output_type {
         enum OutputType output_type;
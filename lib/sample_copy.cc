@@ -0,0 +1,866 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2024 Franco Venturi.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include "sample_copy.h"
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define SDRPLAY3_SIMD_X86_64
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#elif defined(__aarch64__) || defined(_M_ARM64) || defined(__ARM_NEON)
+#define SDRPLAY3_SIMD_NEON
+#include <arm_neon.h>
+#endif
+
+// gcc and clang need to be told which instruction set a function can use;
+// MSVC lets us use all the intrinsics in any function
+#if defined(__GNUC__) || defined(__clang__)
+#define SDRPLAY3_TARGET(isa) __attribute__((target(isa)))
+#else
+#define SDRPLAY3_TARGET(isa)
+#endif
+
+namespace gr {
+namespace sdrplay3 {
+
+// 1/32768 is a power of 2, so multiplying by it gives exactly the same
+// results as dividing by 32768
+static constexpr float fc32_scale = 1.0f / 32768.0f;
+
+/**********************************************************************
+ * Scalar (fallback)
+ *********************************************************************/
+static void fc32_scalar(const short* xi, const short* xq,
+                        std::complex<float>* out, size_t nsamples)
+{
+    for (size_t i = 0; i < nsamples; ++i)
+        out[i] = std::complex<float>(static_cast<float>(xi[i]) * fc32_scale,
+                                     static_cast<float>(xq[i]) * fc32_scale);
+}
+
+static void sc16_scalar(const short* xi, const short* xq, short (*out)[2],
+                        size_t nsamples)
+{
+    for (size_t i = 0; i < nsamples; ++i) {
+        out[i][0] = xi[i];
+        out[i][1] = xq[i];
+    }
+}
+
+static void f32_scalar(const short* x, float* out, size_t nsamples)
+{
+    for (size_t i = 0; i < nsamples; ++i)
+        out[i] = static_cast<float>(x[i]) * fc32_scale;
+}
+
+static inline signed char saturate_sc8(int x)
+{
+    return static_cast<signed char>(x < -128 ? -128 : (x > 127 ? 127 : x));
+}
+
+static void sc8_scalar(const short* xi, const short* xq, signed char (*out)[2],
+                       size_t nsamples, int shift)
+{
+    for (size_t i = 0; i < nsamples; ++i) {
+        out[i][0] = saturate_sc8(xi[i] >> shift);
+        out[i][1] = saturate_sc8(xq[i] >> shift);
+    }
+}
+
+static unsigned int peak_scalar(const short* xi, const short* xq, size_t nsamples)
+{
+    int peak = 0;
+    for (size_t i = 0; i < nsamples; ++i) {
+        int ai = xi[i] < 0 ? -xi[i] : xi[i];
+        int aq = xq[i] < 0 ? -xq[i] : xq[i];
+        peak = ai > peak ? ai : peak;
+        peak = aq > peak ? aq : peak;
+    }
+    return static_cast<unsigned int>(peak);
+}
+
+// round to nearest (a plain shift would floor, with a DC bias of -0.5 LSB);
+// only the top can go out of the 12 bit range
+static inline int sc12_round(short x)
+{
+    int v = (x + 8) >> 4;
+    return v > 2047 ? 2047 : v;
+}
+
+static void sc12_scalar(const short* xi, const short* xq, unsigned char (*out)[3],
+                        size_t nsamples)
+{
+    for (size_t i = 0; i < nsamples; ++i) {
+        int vi = sc12_round(xi[i]);
+        int vq = sc12_round(xq[i]);
+        out[i][0] = static_cast<unsigned char>(vi);
+        out[i][1] = static_cast<unsigned char>(((vi >> 8) & 0x0f) | (vq << 4));
+        out[i][2] = static_cast<unsigned char>(vq >> 4);
+    }
+}
+
+// sign extend the 12 bit I and Q values in a packed 24 bit word
+static inline int sc12_i(uint32_t w)
+{
+    return static_cast<int32_t>(w << 20) >> 20;
+}
+
+static inline int sc12_q(uint32_t w)
+{
+    return static_cast<int32_t>(w << 8) >> 20;
+}
+
+static inline uint32_t sc12_word(const unsigned char* in)
+{
+    return in[0] | (in[1] << 8) | (static_cast<uint32_t>(in[2]) << 16);
+}
+
+static void sc12_to_sc16_scalar(const unsigned char (*in)[3], short (*out)[2],
+                                size_t nsamples)
+{
+    for (size_t i = 0; i < nsamples; ++i) {
+        uint32_t w = sc12_word(in[i]);
+        out[i][0] = static_cast<short>(sc12_i(w) * 16);
+        out[i][1] = static_cast<short>(sc12_q(w) * 16);
+    }
+}
+
+static void sc12_to_fc32_scalar(const unsigned char (*in)[3],
+                                std::complex<float>* out, size_t nsamples)
+{
+    // same scale as the fc32 output
+    for (size_t i = 0; i < nsamples; ++i) {
+        uint32_t w = sc12_word(in[i]);
+        out[i] = std::complex<float>(static_cast<float>(sc12_i(w) * 16) * fc32_scale,
+                                     static_cast<float>(sc12_q(w) * 16) * fc32_scale);
+    }
+}
+
+// float to IEEE binary16 with round to nearest even (like the F16C and
+// NEON instructions); see https://gist.github.com/rygorous/2156668
+static inline uint16_t float_to_half(float f)
+{
+    const uint32_t f32_infinity = 255u << 23;
+    const uint32_t f16_max = (127u + 16) << 23;
+    const uint32_t denormal_magic = ((127u - 15) + (23 - 10) + 1) << 23;
+    uint32_t x;
+    std::memcpy(&x, &f, sizeof(x));
+    uint32_t sign = x & 0x80000000u;
+    x ^= sign;
+    uint16_t h;
+    if (x >= f16_max) {
+        // overflow to infinity (NaN stays NaN)
+        h = x > f32_infinity ? 0x7e00 : 0x7c00;
+    } else if (x < (113u << 23)) {
+        // subnormal (or zero): let the FPU do the rounding
+        float magic;
+        std::memcpy(&magic, &denormal_magic, sizeof(magic));
+        float v;
+        std::memcpy(&v, &x, sizeof(v));
+        v += magic;
+        std::memcpy(&x, &v, sizeof(x));
+        h = static_cast<uint16_t>(x - denormal_magic);
+    } else {
+        uint32_t mantissa_odd = (x >> 13) & 1;
+        x += (static_cast<uint32_t>(15 - 127) << 23) + 0xfff;
+        x += mantissa_odd;
+        h = static_cast<uint16_t>(x >> 13);
+    }
+    return h | static_cast<uint16_t>(sign >> 16);
+}
+
+static void fc16_scalar(const short* xi, const short* xq, uint16_t (*out)[2],
+                        size_t nsamples)
+{
+    for (size_t i = 0; i < nsamples; ++i) {
+        out[i][0] = float_to_half(static_cast<float>(xi[i]) * fc32_scale);
+        out[i][1] = float_to_half(static_cast<float>(xq[i]) * fc32_scale);
+    }
+}
+
+#ifdef SDRPLAY3_SIMD_X86_64
+/**********************************************************************
+ * SSE2 (always available on x86_64)
+ *********************************************************************/
+static void fc32_sse2(const short* xi, const short* xq,
+                      std::complex<float>* out, size_t nsamples)
+{
+    const __m128 scale = _mm_set1_ps(fc32_scale);
+    float* to = reinterpret_cast<float*>(out);
+    size_t i = 0;
+    for (; i + 8 <= nsamples; i += 8, to += 16) {
+        __m128i vi = _mm_loadu_si128(reinterpret_cast<const __m128i*>(xi + i));
+        __m128i vq = _mm_loadu_si128(reinterpret_cast<const __m128i*>(xq + i));
+        // sign extend to 32 bits (SSE2 has no pmovsxwd)
+        __m128 i_lo = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(vi, vi), 16));
+        __m128 i_hi = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpackhi_epi16(vi, vi), 16));
+        __m128 q_lo = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(vq, vq), 16));
+        __m128 q_hi = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpackhi_epi16(vq, vq), 16));
+        i_lo = _mm_mul_ps(i_lo, scale);
+        i_hi = _mm_mul_ps(i_hi, scale);
+        q_lo = _mm_mul_ps(q_lo, scale);
+        q_hi = _mm_mul_ps(q_hi, scale);
+        _mm_storeu_ps(to, _mm_unpacklo_ps(i_lo, q_lo));
+        _mm_storeu_ps(to + 4, _mm_unpackhi_ps(i_lo, q_lo));
+        _mm_storeu_ps(to + 8, _mm_unpacklo_ps(i_hi, q_hi));
+        _mm_storeu_ps(to + 12, _mm_unpackhi_ps(i_hi, q_hi));
+    }
+    fc32_scalar(xi + i, xq + i, out + i, nsamples - i);
+}
+
+static void f32_sse2(const short* x, float* out, size_t nsamples)
+{
+    const __m128 scale = _mm_set1_ps(fc32_scale);
+    size_t i = 0;
+    for (; i + 8 <= nsamples; i += 8) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(x + i));
+        __m128 lo = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16));
+        __m128 hi = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpackhi_epi16(v, v), 16));
+        _mm_storeu_ps(out + i, _mm_mul_ps(lo, scale));
+        _mm_storeu_ps(out + i + 4, _mm_mul_ps(hi, scale));
+    }
+    f32_scalar(x + i, out + i, nsamples - i);
+}
+
+static void sc16_sse2(const short* xi, const short* xq, short (*out)[2],
+                      size_t nsamples)
+{
+    __m128i* to = reinterpret_cast<__m128i*>(out);
+    size_t i = 0;
+    for (; i + 8 <= nsamples; i += 8, to += 2) {
+        __m128i vi = _mm_loadu_si128(reinterpret_cast<const __m128i*>(xi + i));
+        __m128i vq = _mm_loadu_si128(reinterpret_cast<const __m128i*>(xq + i));
+        _mm_storeu_si128(to, _mm_unpacklo_epi16(vi, vq));
+        _mm_storeu_si128(to + 1, _mm_unpackhi_epi16(vi, vq));
+    }
+    sc16_scalar(xi + i, xq + i, out + i, nsamples - i);
+}
+
+static void sc8_sse2(const short* xi, const short* xq, signed char (*out)[2],
+                     size_t nsamples, int shift)
+{
+    const __m128i count = _mm_cvtsi32_si128(shift);
+    __m128i* to = reinterpret_cast<__m128i*>(out);
+    size_t i = 0;
+    for (; i + 8 <= nsamples; i += 8, ++to) {
+        __m128i vi = _mm_sra_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(xi + i)), count);
+        __m128i vq = _mm_sra_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(xq + i)), count);
+        // packs saturates to int8
+        _mm_storeu_si128(to, _mm_packs_epi16(_mm_unpacklo_epi16(vi, vq),
+                                             _mm_unpackhi_epi16(vi, vq)));
+    }
+    sc8_scalar(xi + i, xq + i, out + i, nsamples - i, shift);
+}
+
+static unsigned int peak_sse2(const short* xi, const short* xq, size_t nsamples)
+{
+    // the absolute values are unsigned 16 bit (|-32768| is 32768, as in
+    // peak_scalar()); SSE2 has no unsigned 16 bit max, so they are compared
+    // as signed values offset by -32768
+    const __m128i bias = _mm_set1_epi16(-32768);
+    __m128i vmax = bias;
+    size_t i = 0;
+    for (; i + 8 <= nsamples; i += 8) {
+        __m128i vi = _mm_loadu_si128(reinterpret_cast<const __m128i*>(xi + i));
+        __m128i vq = _mm_loadu_si128(reinterpret_cast<const __m128i*>(xq + i));
+        __m128i si = _mm_srai_epi16(vi, 15);
+        __m128i sq = _mm_srai_epi16(vq, 15);
+        __m128i ai = _mm_sub_epi16(_mm_xor_si128(vi, si), si);
+        __m128i aq = _mm_sub_epi16(_mm_xor_si128(vq, sq), sq);
+        vmax = _mm_max_epi16(vmax, _mm_xor_si128(ai, bias));
+        vmax = _mm_max_epi16(vmax, _mm_xor_si128(aq, bias));
+    }
+    vmax = _mm_max_epi16(vmax, _mm_shuffle_epi32(vmax, _MM_SHUFFLE(1, 0, 3, 2)));
+    vmax = _mm_max_epi16(vmax, _mm_shuffle_epi32(vmax, _MM_SHUFFLE(2, 3, 0, 1)));
+    vmax = _mm_max_epi16(vmax, _mm_shufflelo_epi16(vmax, _MM_SHUFFLE(2, 3, 0, 1)));
+    unsigned int peak = static_cast<unsigned int>((_mm_cvtsi128_si32(vmax) ^ 0x8000) & 0xffff);
+    unsigned int tail = peak_scalar(xi + i, xq + i, nsamples - i);
+    return tail > peak ? tail : peak;
+}
+
+/**********************************************************************
+ * AVX2
+ *********************************************************************/
+SDRPLAY3_TARGET("avx2")
+static void fc32_avx2(const short* xi, const short* xq,
+                      std::complex<float>* out, size_t nsamples)
+{
+    const __m256 scale = _mm256_set1_ps(fc32_scale);
+    float* to = reinterpret_cast<float*>(out);
+    size_t i = 0;
+    for (; i + 8 <= nsamples; i += 8, to += 16) {
+        __m128i vi = _mm_loadu_si128(reinterpret_cast<const __m128i*>(xi + i));
+        __m128i vq = _mm_loadu_si128(reinterpret_cast<const __m128i*>(xq + i));
+        __m256 fi = _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(vi)), scale);
+        __m256 fq = _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(vq)), scale);
+        // lo = i0 q0 i1 q1 | i4 q4 i5 q5, hi = i2 q2 i3 q3 | i6 q6 i7 q7
+        __m256 lo = _mm256_unpacklo_ps(fi, fq);
+        __m256 hi = _mm256_unpackhi_ps(fi, fq);
+        _mm256_storeu_ps(to, _mm256_permute2f128_ps(lo, hi, 0x20));
+        _mm256_storeu_ps(to + 8, _mm256_permute2f128_ps(lo, hi, 0x31));
+    }
+    fc32_sse2(xi + i, xq + i, out + i, nsamples - i);
+}
+
+SDRPLAY3_TARGET("avx2")
+static void f32_avx2(const short* x, float* out, size_t nsamples)
+{
+    const __m256 scale = _mm256_set1_ps(fc32_scale);
+    size_t i = 0;
+    for (; i + 16 <= nsamples; i += 16) {
+        __m128i lo = _mm_loadu_si128(reinterpret_cast<const __m128i*>(x + i));
+        __m128i hi = _mm_loadu_si128(reinterpret_cast<const __m128i*>(x + i + 8));
+        _mm256_storeu_ps(out + i,
+            _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(lo)), scale));
+        _mm256_storeu_ps(out + i + 8,
+            _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(hi)), scale));
+    }
+    f32_sse2(x + i, out + i, nsamples - i);
+}
+
+SDRPLAY3_TARGET("avx2")
+static void sc16_avx2(const short* xi, const short* xq, short (*out)[2],
+                      size_t nsamples)
+{
+    __m256i* to = reinterpret_cast<__m256i*>(out);
+    size_t i = 0;
+    for (; i + 16 <= nsamples; i += 16, to += 2) {
+        __m256i vi = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(xi + i));
+        __m256i vq = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(xq + i));
+        // lo = samples 0-3 | 8-11, hi = samples 4-7 | 12-15
+        __m256i lo = _mm256_unpacklo_epi16(vi, vq);
+        __m256i hi = _mm256_unpackhi_epi16(vi, vq);
+        _mm256_storeu_si256(to, _mm256_permute2x128_si256(lo, hi, 0x20));
+        _mm256_storeu_si256(to + 1, _mm256_permute2x128_si256(lo, hi, 0x31));
+    }
+    sc16_sse2(xi + i, xq + i, out + i, nsamples - i);
+}
+
+SDRPLAY3_TARGET("avx2")
+static void sc8_avx2(const short* xi, const short* xq, signed char (*out)[2],
+                     size_t nsamples, int shift)
+{
+    const __m128i count = _mm_cvtsi32_si128(shift);
+    __m256i* to = reinterpret_cast<__m256i*>(out);
+    size_t i = 0;
+    for (; i + 16 <= nsamples; i += 16, ++to) {
+        __m256i vi = _mm256_sra_epi16(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(xi + i)), count);
+        __m256i vq = _mm256_sra_epi16(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(xq + i)), count);
+        // lo = samples 0-3 | 8-11, hi = samples 4-7 | 12-15; the 128 bit
+        // lane packs put them back in order
+        __m256i lo = _mm256_unpacklo_epi16(vi, vq);
+        __m256i hi = _mm256_unpackhi_epi16(vi, vq);
+        _mm256_storeu_si256(to, _mm256_packs_epi16(lo, hi));
+    }
+    sc8_sse2(xi + i, xq + i, out + i, nsamples - i, shift);
+}
+
+SDRPLAY3_TARGET("avx2")
+static unsigned int peak_avx2(const short* xi, const short* xq, size_t nsamples)
+{
+    // |-32768| is 32768 as an unsigned 16 bit value
+    __m256i vmax = _mm256_setzero_si256();
+    size_t i = 0;
+    for (; i + 16 <= nsamples; i += 16) {
+        __m256i vi = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(xi + i));
+        __m256i vq = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(xq + i));
+        vmax = _mm256_max_epu16(vmax, _mm256_abs_epi16(vi));
+        vmax = _mm256_max_epu16(vmax, _mm256_abs_epi16(vq));
+    }
+    __m128i v = _mm_max_epu16(_mm256_castsi256_si128(vmax),
+                              _mm256_extracti128_si256(vmax, 1));
+    // minpos finds the smallest value, so search the complement
+    v = _mm_minpos_epu16(_mm_xor_si128(v, _mm_set1_epi16(-1)));
+    unsigned int peak = (~static_cast<unsigned int>(_mm_cvtsi128_si32(v))) & 0xffff;
+    unsigned int tail = peak_scalar(xi + i, xq + i, nsamples - i);
+    return tail > peak ? tail : peak;
+}
+
+// sc12 uses byte shuffles (SSSE3, so there are no SSE2 versions); 8 samples
+// are 8 packed 24 bit words, i.e. 24 bytes
+SDRPLAY3_TARGET("avx2")
+static void sc12_avx2(const short* xi, const short* xq, unsigned char (*out)[3],
+                      size_t nsamples)
+{
+    // pack the 4 words in each 128 bit lane into its lowest 12 bytes, then
+    // move the 3 dwords of the upper lane next to the ones of the lower lane
+    const __m256i pack = _mm256_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1,
+                                          0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+    const __m256i lanes = _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 3, 7);
+    const __m256i mask_i = _mm256_set1_epi32(0x000fff);
+    const __m256i mask_q = _mm256_set1_epi32(0xfff000);
+    // rounded as in sc12_scalar (the saturated add clamps 32767)
+    const __m128i half = _mm_set1_epi16(8);
+    unsigned char* to = reinterpret_cast<unsigned char*>(out);
+    size_t i = 0;
+    for (; i + 8 <= nsamples; i += 8, to += 24) {
+        __m128i vi = _mm_srai_epi16(_mm_adds_epi16(
+            _mm_loadu_si128(reinterpret_cast<const __m128i*>(xi + i)), half), 4);
+        __m128i vq = _mm_srai_epi16(_mm_adds_epi16(
+            _mm_loadu_si128(reinterpret_cast<const __m128i*>(xq + i)), half), 4);
+        // I/Q pairs as 32 bit words (I in the low half)
+        __m256i iq = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_unpacklo_epi16(vi, vq)),
+                                             _mm_unpackhi_epi16(vi, vq), 1);
+        __m256i w = _mm256_or_si256(_mm256_and_si256(iq, mask_i),
+                                    _mm256_and_si256(_mm256_srli_epi32(iq, 4), mask_q));
+        w = _mm256_permutevar8x32_epi32(_mm256_shuffle_epi8(w, pack), lanes);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(to), _mm256_castsi256_si128(w));
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(to + 16), _mm256_extracti128_si256(w, 1));
+    }
+    sc12_scalar(xi + i, xq + i, out + i, nsamples - i);
+}
+
+// load 8 packed samples and expand them to one 24 bit word per dword
+SDRPLAY3_TARGET("avx2")
+static inline __m256i sc12_load_avx2(const unsigned char* from)
+{
+    const __m256i lanes = _mm256_setr_epi32(0, 1, 2, 0, 3, 4, 5, 0);
+    const __m256i expand = _mm256_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1,
+                                            0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+    __m256i v = _mm256_inserti128_si256(
+        _mm256_castsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i*>(from))),
+        _mm_loadl_epi64(reinterpret_cast<const __m128i*>(from + 16)), 1);
+    return _mm256_shuffle_epi8(_mm256_permutevar8x32_epi32(v, lanes), expand);
+}
+
+SDRPLAY3_TARGET("avx2")
+static void sc12_to_sc16_avx2(const unsigned char (*in)[3], short (*out)[2],
+                              size_t nsamples)
+{
+    const __m256i mask_q = _mm256_set1_epi32(static_cast<int>(0xfff00000));
+    const unsigned char* from = reinterpret_cast<const unsigned char*>(in);
+    __m256i* to = reinterpret_cast<__m256i*>(out);
+    size_t i = 0;
+    for (; i + 8 <= nsamples; i += 8, from += 24, ++to) {
+        __m256i w = sc12_load_avx2(from);
+        // I << 4 in the low half, Q << 4 in the high half
+        __m256i vi = _mm256_srli_epi32(_mm256_slli_epi32(w, 20), 16);
+        __m256i vq = _mm256_and_si256(_mm256_slli_epi32(w, 8), mask_q);
+        _mm256_storeu_si256(to, _mm256_or_si256(vi, vq));
+    }
+    sc12_to_sc16_scalar(in + i, out + i, nsamples - i);
+}
+
+SDRPLAY3_TARGET("avx2")
+static void sc12_to_fc32_avx2(const unsigned char (*in)[3],
+                              std::complex<float>* out, size_t nsamples)
+{
+    const __m256 scale = _mm256_set1_ps(fc32_scale);
+    const unsigned char* from = reinterpret_cast<const unsigned char*>(in);
+    float* to = reinterpret_cast<float*>(out);
+    size_t i = 0;
+    for (; i + 8 <= nsamples; i += 8, from += 24, to += 16) {
+        __m256i w = sc12_load_avx2(from);
+        // sign extended I << 4 and Q << 4
+        __m256i vi = _mm256_srai_epi32(_mm256_slli_epi32(w, 20), 16);
+        __m256i vq = _mm256_slli_epi32(_mm256_srai_epi32(_mm256_slli_epi32(w, 8), 20), 4);
+        __m256 fi = _mm256_mul_ps(_mm256_cvtepi32_ps(vi), scale);
+        __m256 fq = _mm256_mul_ps(_mm256_cvtepi32_ps(vq), scale);
+        __m256 lo = _mm256_unpacklo_ps(fi, fq);
+        __m256 hi = _mm256_unpackhi_ps(fi, fq);
+        _mm256_storeu_ps(to, _mm256_permute2f128_ps(lo, hi, 0x20));
+        _mm256_storeu_ps(to + 8, _mm256_permute2f128_ps(lo, hi, 0x31));
+    }
+    sc12_to_fc32_scalar(in + i, out + i, nsamples - i);
+}
+
+// every CPU with AVX2 so far also has F16C, but it is a separate feature
+SDRPLAY3_TARGET("avx2,f16c")
+static void fc16_f16c(const short* xi, const short* xq, uint16_t (*out)[2],
+                      size_t nsamples)
+{
+    const __m256 scale = _mm256_set1_ps(fc32_scale);
+    __m128i* to = reinterpret_cast<__m128i*>(out);
+    size_t i = 0;
+    for (; i + 8 <= nsamples; i += 8, to += 2) {
+        __m128i vi = _mm_loadu_si128(reinterpret_cast<const __m128i*>(xi + i));
+        __m128i vq = _mm_loadu_si128(reinterpret_cast<const __m128i*>(xq + i));
+        __m256 fi = _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(vi)), scale);
+        __m256 fq = _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(vq)), scale);
+        __m256 lo = _mm256_unpacklo_ps(fi, fq);
+        __m256 hi = _mm256_unpackhi_ps(fi, fq);
+        _mm_storeu_si128(to, _mm256_cvtps_ph(_mm256_permute2f128_ps(lo, hi, 0x20),
+                                             _MM_FROUND_TO_NEAREST_INT));
+        _mm_storeu_si128(to + 1, _mm256_cvtps_ph(_mm256_permute2f128_ps(lo, hi, 0x31),
+                                                 _MM_FROUND_TO_NEAREST_INT));
+    }
+    fc16_scalar(xi + i, xq + i, out + i, nsamples - i);
+}
+
+/**********************************************************************
+ * AVX-512 (only AVX512F instructions are used)
+ *********************************************************************/
+// number of samples to process before out is aligned to a cache line;
+// 64 byte stores that straddle two cache lines cost more than all the
+// AVX-512 gains
+template <typename T>
+static size_t samples_to_cache_line(const T* out, size_t nsamples)
+{
+    size_t misalignment = reinterpret_cast<uintptr_t>(out) & 63;
+    size_t n = misalignment == 0 ? 0 : (64 - misalignment) / sizeof(T);
+    return n < nsamples ? n : nsamples;
+}
+
+// the AVX-512 conversions, shifts and unpacks are the zero masked forms
+// with all the lanes enabled: the plain ones start from an undefined
+// register, which makes GCC 12 warn (-Wmaybe-uninitialized)
+static constexpr __mmask16 AllLanes16 = 0xffff;
+
+SDRPLAY3_TARGET("avx512f")
+static void fc32_avx512(const short* xi, const short* xq,
+                        std::complex<float>* out, size_t nsamples)
+{
+    const __m512 scale = _mm512_set1_ps(fc32_scale);
+    const __m512i idx_lo = _mm512_setr_epi32(0, 1, 2, 3, 16, 17, 18, 19,
+                                             4, 5, 6, 7, 20, 21, 22, 23);
+    const __m512i idx_hi = _mm512_setr_epi32(8, 9, 10, 11, 24, 25, 26, 27,
+                                             12, 13, 14, 15, 28, 29, 30, 31);
+    size_t i = samples_to_cache_line(out, nsamples);
+    fc32_avx2(xi, xq, out, i);
+    float* to = reinterpret_cast<float*>(out + i);
+    for (; i + 16 <= nsamples; i += 16, to += 32) {
+        __m256i vi = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(xi + i));
+        __m256i vq = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(xq + i));
+        __m512i wi = _mm512_maskz_cvtepi16_epi32(AllLanes16, vi);
+        __m512i wq = _mm512_maskz_cvtepi16_epi32(AllLanes16, vq);
+        __m512 fi = _mm512_mul_ps(_mm512_maskz_cvtepi32_ps(AllLanes16, wi), scale);
+        __m512 fq = _mm512_mul_ps(_mm512_maskz_cvtepi32_ps(AllLanes16, wq), scale);
+        // unpack works within 128 bit lanes; permute the lanes back in order
+        __m512 lo = _mm512_maskz_unpacklo_ps(AllLanes16, fi, fq);
+        __m512 hi = _mm512_maskz_unpackhi_ps(AllLanes16, fi, fq);
+        _mm512_storeu_ps(to, _mm512_permutex2var_ps(lo, idx_lo, hi));
+        _mm512_storeu_ps(to + 16, _mm512_permutex2var_ps(lo, idx_hi, hi));
+    }
+    fc32_avx2(xi + i, xq + i, out + i, nsamples - i);
+}
+
+SDRPLAY3_TARGET("avx512f")
+static void sc16_avx512(const short* xi, const short* xq, short (*out)[2],
+                        size_t nsamples)
+{
+    size_t i = samples_to_cache_line(out, nsamples);
+    sc16_avx2(xi, xq, out, i);
+    __m512i* to = reinterpret_cast<__m512i*>(out + i);
+    for (; i + 16 <= nsamples; i += 16, ++to) {
+        __m256i vi = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(xi + i));
+        __m256i vq = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(xq + i));
+        // each I/Q pair is a 32 bit word with I in the low half (the sign
+        // extension of I is masked off, the one of Q shifted out)
+        __m512i pi = _mm512_and_si512(_mm512_maskz_cvtepi16_epi32(AllLanes16, vi),
+                                      _mm512_set1_epi32(0xffff));
+        __m512i wq = _mm512_maskz_cvtepi16_epi32(AllLanes16, vq);
+        __m512i pq = _mm512_maskz_slli_epi32(AllLanes16, wq, 16);
+        _mm512_storeu_si512(to, _mm512_or_si512(pi, pq));
+    }
+    sc16_avx2(xi + i, xq + i, out + i, nsamples - i);
+}
+
+static bool cpu_supports_avx2()
+{
+#ifdef _MSC_VER
+    int info[4];
+    __cpuid(info, 0);
+    if (info[0] < 7)
+        return false;
+    __cpuid(info, 1);
+    if (!(info[2] & (1 << 27)) || (_xgetbv(0) & 0x06) != 0x06)
+        return false;
+    __cpuidex(info, 7, 0);
+    return info[1] & (1 << 5);
+#else
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2");
+#endif
+}
+
+static bool cpu_supports_avx512f()
+{
+#ifdef _MSC_VER
+    int info[4];
+    __cpuid(info, 0);
+    if (info[0] < 7)
+        return false;
+    __cpuid(info, 1);
+    if (!(info[2] & (1 << 27)) || (_xgetbv(0) & 0xe6) != 0xe6)
+        return false;
+    __cpuidex(info, 7, 0);
+    return info[1] & (1 << 16);
+#else
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx512f");
+#endif
+}
+
+static bool cpu_supports_f16c()
+{
+#ifdef _MSC_VER
+    int info[4];
+    __cpuid(info, 1);
+    return info[2] & (1 << 29);
+#else
+    unsigned int eax, ebx, ecx, edx;
+    return __get_cpuid(1, &eax, &ebx, &ecx, &edx) && (ecx & (1 << 29));
+#endif
+}
+#endif /* SDRPLAY3_SIMD_X86_64 */
+
+#ifdef SDRPLAY3_SIMD_NEON
+/**********************************************************************
+ * NEON (always available on aarch64)
+ *********************************************************************/
+static void fc32_neon(const short* xi, const short* xq,
+                      std::complex<float>* out, size_t nsamples)
+{
+    float* to = reinterpret_cast<float*>(out);
+    size_t i = 0;
+    for (; i + 8 <= nsamples; i += 8, to += 16) {
+        int16x8_t vi = vld1q_s16(xi + i);
+        int16x8_t vq = vld1q_s16(xq + i);
+        float32x4x2_t lo;
+        lo.val[0] = vmulq_n_f32(vcvtq_f32_s32(vmovl_s16(vget_low_s16(vi))), fc32_scale);
+        lo.val[1] = vmulq_n_f32(vcvtq_f32_s32(vmovl_s16(vget_low_s16(vq))), fc32_scale);
+        float32x4x2_t hi;
+        hi.val[0] = vmulq_n_f32(vcvtq_f32_s32(vmovl_s16(vget_high_s16(vi))), fc32_scale);
+        hi.val[1] = vmulq_n_f32(vcvtq_f32_s32(vmovl_s16(vget_high_s16(vq))), fc32_scale);
+        // vst2 stores the two registers interleaved
+        vst2q_f32(to, lo);
+        vst2q_f32(to + 8, hi);
+    }
+    fc32_scalar(xi + i, xq + i, out + i, nsamples - i);
+}
+
+static void f32_neon(const short* x, float* out, size_t nsamples)
+{
+    size_t i = 0;
+    for (; i + 8 <= nsamples; i += 8) {
+        int16x8_t v = vld1q_s16(x + i);
+        vst1q_f32(out + i, vmulq_n_f32(vcvtq_f32_s32(vmovl_s16(vget_low_s16(v))), fc32_scale));
+        vst1q_f32(out + i + 4, vmulq_n_f32(vcvtq_f32_s32(vmovl_s16(vget_high_s16(v))), fc32_scale));
+    }
+    f32_scalar(x + i, out + i, nsamples - i);
+}
+
+static void sc16_neon(const short* xi, const short* xq, short (*out)[2],
+                      size_t nsamples)
+{
+    int16_t* to = reinterpret_cast<int16_t*>(out);
+    size_t i = 0;
+    for (; i + 8 <= nsamples; i += 8, to += 16) {
+        int16x8x2_t v;
+        v.val[0] = vld1q_s16(xi + i);
+        v.val[1] = vld1q_s16(xq + i);
+        vst2q_s16(to, v);
+    }
+    sc16_scalar(xi + i, xq + i, out + i, nsamples - i);
+}
+
+static void sc8_neon(const short* xi, const short* xq, signed char (*out)[2],
+                     size_t nsamples, int shift)
+{
+    const int16x8_t count = vdupq_n_s16(static_cast<int16_t>(-shift));
+    int8_t* to = reinterpret_cast<int8_t*>(out);
+    size_t i = 0;
+    for (; i + 8 <= nsamples; i += 8, to += 16) {
+        // vshl by a negative count is an arithmetic shift right; vqmovn
+        // saturates to int8
+        int8x8x2_t v;
+        v.val[0] = vqmovn_s16(vshlq_s16(vld1q_s16(xi + i), count));
+        v.val[1] = vqmovn_s16(vshlq_s16(vld1q_s16(xq + i), count));
+        vst2_s8(to, v);
+    }
+    sc8_scalar(xi + i, xq + i, out + i, nsamples - i, shift);
+}
+
+static unsigned int peak_neon(const short* xi, const short* xq, size_t nsamples)
+{
+    // |-32768| wraps to 0x8000, which is 32768 as an unsigned 16 bit value
+    // (as in peak_scalar())
+    uint16x8_t vmax = vdupq_n_u16(0);
+    size_t i = 0;
+    for (; i + 8 <= nsamples; i += 8) {
+        vmax = vmaxq_u16(vmax, vreinterpretq_u16_s16(vabsq_s16(vld1q_s16(xi + i))));
+        vmax = vmaxq_u16(vmax, vreinterpretq_u16_s16(vabsq_s16(vld1q_s16(xq + i))));
+    }
+    uint16x4_t v = vmax_u16(vget_low_u16(vmax), vget_high_u16(vmax));
+    v = vpmax_u16(v, v);
+    v = vpmax_u16(v, v);
+    unsigned int peak = static_cast<unsigned int>(vget_lane_u16(v, 0));
+    unsigned int tail = peak_scalar(xi + i, xq + i, nsamples - i);
+    return tail > peak ? tail : peak;
+}
+
+static void sc12_neon(const short* xi, const short* xq, unsigned char (*out)[3],
+                      size_t nsamples)
+{
+    // rounded as in sc12_scalar (vrshr would give 2048 for 32767, so a
+    // saturated add instead)
+    const int16x8_t half = vdupq_n_s16(8);
+    uint8_t* to = reinterpret_cast<uint8_t*>(out);
+    size_t i = 0;
+    for (; i + 8 <= nsamples; i += 8, to += 24) {
+        uint16x8_t vi = vreinterpretq_u16_s16(vshrq_n_s16(vqaddq_s16(vld1q_s16(xi + i), half), 4));
+        uint16x8_t vq = vreinterpretq_u16_s16(vshrq_n_s16(vqaddq_s16(vld1q_s16(xq + i), half), 4));
+        // the three bytes of each sample (vmovn keeps the low 8 bits);
+        // vst3 interleaves them
+        uint8x8x3_t v;
+        v.val[0] = vmovn_u16(vi);
+        v.val[1] = vmovn_u16(vorrq_u16(vandq_u16(vshrq_n_u16(vi, 8), vdupq_n_u16(0x0f)),
+                                       vshlq_n_u16(vq, 4)));
+        v.val[2] = vmovn_u16(vshrq_n_u16(vq, 4));
+        vst3_u8(to, v);
+    }
+    sc12_scalar(xi + i, xq + i, out + i, nsamples - i);
+}
+
+// I << 4 and Q << 4 from the three bytes of 8 packed samples
+static inline int16x8x2_t sc12_load_neon(const unsigned char* from)
+{
+    uint8x8x3_t v = vld3_u8(from);
+    uint16x8_t b0 = vmovl_u8(v.val[0]);
+    uint16x8_t b1 = vmovl_u8(v.val[1]);
+    uint16x8_t b2 = vmovl_u8(v.val[2]);
+    int16x8x2_t iq;
+    iq.val[0] = vreinterpretq_s16_u16(vorrq_u16(vshlq_n_u16(b0, 4), vshlq_n_u16(b1, 12)));
+    iq.val[1] = vreinterpretq_s16_u16(vorrq_u16(vandq_u16(b1, vdupq_n_u16(0xf0)),
+                                                vshlq_n_u16(b2, 8)));
+    return iq;
+}
+
+static void sc12_to_sc16_neon(const unsigned char (*in)[3], short (*out)[2],
+                              size_t nsamples)
+{
+    const unsigned char* from = reinterpret_cast<const unsigned char*>(in);
+    int16_t* to = reinterpret_cast<int16_t*>(out);
+    size_t i = 0;
+    for (; i + 8 <= nsamples; i += 8, from += 24, to += 16)
+        vst2q_s16(to, sc12_load_neon(from));
+    sc12_to_sc16_scalar(in + i, out + i, nsamples - i);
+}
+
+static void sc12_to_fc32_neon(const unsigned char (*in)[3],
+                              std::complex<float>* out, size_t nsamples)
+{
+    const unsigned char* from = reinterpret_cast<const unsigned char*>(in);
+    float* to = reinterpret_cast<float*>(out);
+    size_t i = 0;
+    for (; i + 8 <= nsamples; i += 8, from += 24, to += 16) {
+        int16x8x2_t iq = sc12_load_neon(from);
+        float32x4x2_t lo;
+        lo.val[0] = vmulq_n_f32(vcvtq_f32_s32(vmovl_s16(vget_low_s16(iq.val[0]))), fc32_scale);
+        lo.val[1] = vmulq_n_f32(vcvtq_f32_s32(vmovl_s16(vget_low_s16(iq.val[1]))), fc32_scale);
+        float32x4x2_t hi;
+        hi.val[0] = vmulq_n_f32(vcvtq_f32_s32(vmovl_s16(vget_high_s16(iq.val[0]))), fc32_scale);
+        hi.val[1] = vmulq_n_f32(vcvtq_f32_s32(vmovl_s16(vget_high_s16(iq.val[1]))), fc32_scale);
+        vst2q_f32(to, lo);
+        vst2q_f32(to + 8, hi);
+    }
+    sc12_to_fc32_scalar(in + i, out + i, nsamples - i);
+}
+
+#if defined(__aarch64__) || defined(_M_ARM64)
+// the conversion to half precision is only in the 64 bit instruction set
+static void fc16_neon(const short* xi, const short* xq, uint16_t (*out)[2],
+                      size_t nsamples)
+{
+    uint16_t* to = reinterpret_cast<uint16_t*>(out);
+    size_t i = 0;
+    for (; i + 8 <= nsamples; i += 8, to += 16) {
+        int16x8_t vi = vld1q_s16(xi + i);
+        int16x8_t vq = vld1q_s16(xq + i);
+        uint16x4x2_t lo;
+        lo.val[0] = vreinterpret_u16_f16(vcvt_f16_f32(
+            vmulq_n_f32(vcvtq_f32_s32(vmovl_s16(vget_low_s16(vi))), fc32_scale)));
+        lo.val[1] = vreinterpret_u16_f16(vcvt_f16_f32(
+            vmulq_n_f32(vcvtq_f32_s32(vmovl_s16(vget_low_s16(vq))), fc32_scale)));
+        uint16x4x2_t hi;
+        hi.val[0] = vreinterpret_u16_f16(vcvt_f16_f32(
+            vmulq_n_f32(vcvtq_f32_s32(vmovl_s16(vget_high_s16(vi))), fc32_scale)));
+        hi.val[1] = vreinterpret_u16_f16(vcvt_f16_f32(
+            vmulq_n_f32(vcvtq_f32_s32(vmovl_s16(vget_high_s16(vq))), fc32_scale)));
+        vst2_u16(to, lo);
+        vst2_u16(to + 8, hi);
+    }
+    fc16_scalar(xi + i, xq + i, out + i, nsamples - i);
+}
+#else
+#define fc16_neon fc16_scalar
+#endif
+#endif /* SDRPLAY3_SIMD_NEON */
+
+
+static std::vector<sample_copy_kernels> supported_kernels()
+{
+    std::vector<sample_copy_kernels> kernels = {
+        { "scalar", fc32_scalar, sc16_scalar, sc8_scalar, peak_scalar,
+          sc12_scalar, sc12_to_sc16_scalar, sc12_to_fc32_scalar, fc16_scalar,
+          f32_scalar }
+    };
+#ifdef SDRPLAY3_SIMD_X86_64
+    kernels.push_back({ "sse2", fc32_sse2, sc16_sse2, sc8_sse2, peak_sse2,
+                        sc12_scalar, sc12_to_sc16_scalar, sc12_to_fc32_scalar,
+                        fc16_scalar, f32_sse2 });
+    auto fc16_avx2 = cpu_supports_f16c() ? fc16_f16c : fc16_scalar;
+    if (cpu_supports_avx2())
+        kernels.push_back({ "avx2", fc32_avx2, sc16_avx2, sc8_avx2, peak_avx2,
+                            sc12_avx2, sc12_to_sc16_avx2, sc12_to_fc32_avx2,
+                            fc16_avx2, f32_avx2 });
+    // only fc32 and sc16 have AVX-512 (AVX512F) versions: the 16 bit
+    // AVX-512 instructions (AVX512BW) are not used, so the sc8, peak, sc12,
+    // sc12_to_sc16, sc12_to_fc32, fc16 and f32 kernels of this set are the
+    // AVX2 ones
+    if (cpu_supports_avx2() && cpu_supports_avx512f())
+        kernels.push_back({ "avx512", fc32_avx512, sc16_avx512, sc8_avx2, peak_avx2,
+                            sc12_avx2, sc12_to_sc16_avx2, sc12_to_fc32_avx2,
+                            fc16_avx2, f32_avx2 });
+#endif
+#ifdef SDRPLAY3_SIMD_NEON
+    kernels.push_back({ "neon", fc32_neon, sc16_neon, sc8_neon, peak_neon,
+                        sc12_neon, sc12_to_sc16_neon, sc12_to_fc32_neon,
+                        fc16_neon, f32_neon });
+#endif
+    return kernels;
+}
+
+const std::vector<sample_copy_kernels>& get_all_sample_copy_kernels()
+{
+    static const std::vector<sample_copy_kernels> kernels = supported_kernels();
+    return kernels;
+}
+
+static const sample_copy_kernels& select_sample_copy_kernels()
+{
+    const auto& kernels = get_all_sample_copy_kernels();
+    const char* simd = std::getenv("SDRPLAY3_SIMD");
+    if (simd) {
+        for (const auto& k : kernels) {
+            if (std::strcmp(k.name, simd) == 0)
+                return k;
+        }
+    }
+    // the last one is the most capable
+    return kernels.back();
+}
+
+const sample_copy_kernels& get_sample_copy_kernels()
+{
+    static const sample_copy_kernels& kernels = select_sample_copy_kernels();
+    return kernels;
+}
+
+// select the kernels when the library is loaded, not in the first work()
+[[maybe_unused]] static const sample_copy_kernels& selected_kernels =
+    get_sample_copy_kernels();
+
+} /* namespace sdrplay3 */
+} /* namespace gr */
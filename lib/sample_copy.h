@@ -0,0 +1,67 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2024 Franco Venturi.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#ifndef INCLUDED_SDRPLAY3_SAMPLE_COPY_H
+#define INCLUDED_SDRPLAY3_SAMPLE_COPY_H
+
+#include <complex>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace gr {
+namespace sdrplay3 {
+
+// Kernels that interleave the I and Q arrays from the SDRplay API and
+// convert them to the output type in a single pass over the output (plus
+// the peak detector for the sc8 automatic scaling, and the conversion of
+// a single array for the split I/Q output).
+// The best implementation for the CPU is selected when the library is
+// loaded; the environment variable SDRPLAY3_SIMD (scalar, sse2, avx2,
+// avx512, neon) can be used to force a specific one. The avx512 set only
+// has AVX-512 versions of fc32 and sc16 (the others are the AVX2 ones).
+struct sample_copy_kernels {
+    const char* name;
+    // complex float scaled to [-1.0, 1.0)
+    void (*fc32)(const short* xi, const short* xq, std::complex<float>* out,
+                 size_t nsamples);
+    // complex int16 (I/Q pairs)
+    void (*sc16)(const short* xi, const short* xq, short (*out)[2],
+                 size_t nsamples);
+    // complex int8 (I/Q pairs), shifted right by 'shift' bits (0-8) and
+    // saturated to [-128, 127]
+    void (*sc8)(const short* xi, const short* xq, signed char (*out)[2],
+                size_t nsamples, int shift);
+    // largest absolute value of the I and Q samples
+    unsigned int (*peak)(const short* xi, const short* xq, size_t nsamples);
+    // complex int12 packed in 3 bytes: I and Q rounded to their 12 most
+    // significant bits (saturated at 2047), as a 24 bit little endian word
+    // (I in bits 0-11, Q in bits 12-23)
+    void (*sc12)(const short* xi, const short* xq, unsigned char (*out)[3],
+                 size_t nsamples);
+    // sc12 back to complex int16 and complex float (sc12_unpack block)
+    void (*sc12_to_sc16)(const unsigned char (*in)[3], short (*out)[2],
+                         size_t nsamples);
+    void (*sc12_to_fc32)(const unsigned char (*in)[3], std::complex<float>* out,
+                         size_t nsamples);
+    // complex IEEE binary16 (half precision float) scaled to [-1.0, 1.0)
+    void (*fc16)(const short* xi, const short* xq, uint16_t (*out)[2],
+                 size_t nsamples);
+    // float scaled to [-1.0, 1.0) (one of the I and Q arrays for the split
+    // I/Q output)
+    void (*f32)(const short* x, float* out, size_t nsamples);
+};
+
+const sample_copy_kernels& get_sample_copy_kernels();
+
+// all the kernels supported by this CPU (scalar first) - for benchmarks
+const std::vector<sample_copy_kernels>& get_all_sample_copy_kernels();
+
+} // namespace sdrplay3
+} // namespace gr
+
+#endif /* INCLUDED_SDRPLAY3_SAMPLE_COPY_H */
@@ -0,0 +1,61 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2024 Franco Venturi.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "sc12_unpack_impl.h"
+#include "sample_copy.h"
+#include <gnuradio/io_signature.h>
+#include <stdexcept>
+
+namespace gr {
+namespace sdrplay3 {
+
+sc12_unpack::sptr sc12_unpack::make(const std::string& output_type)
+{
+    return sc12_unpack::sptr(new sc12_unpack_impl(output_type));
+}
+
+sc12_unpack_impl::sc12_unpack_impl(const std::string& output_type)
+    : gr::sync_block("sc12_unpack",
+                     io_signature::make(1, 1, sizeof(unsigned char[3])),
+                     io_signature::make(1, 1, output_size(output_type))),
+      output_fc32(output_type == "fc32")
+{
+}
+
+sc12_unpack_impl::~sc12_unpack_impl() {}
+
+size_t sc12_unpack_impl::output_size(const std::string& output_type)
+{
+    if (output_type == "fc32")
+        return sizeof(gr_complex);
+    if (output_type == "sc16")
+        return sizeof(short[2]);
+    throw std::invalid_argument("invalid output type: " + output_type);
+}
+
+int sc12_unpack_impl::work(int noutput_items,
+                           gr_vector_const_void_star& input_items,
+                           gr_vector_void_star& output_items)
+{
+    auto in = static_cast<const unsigned char (*)[3]>(input_items[0]);
+    const auto& kernels = get_sample_copy_kernels();
+    if (output_fc32) {
+        kernels.sc12_to_fc32(in, static_cast<gr_complex *>(output_items[0]),
+                             noutput_items);
+    } else {
+        kernels.sc12_to_sc16(in, static_cast<short (*)[2]>(output_items[0]),
+                             noutput_items);
+    }
+    return noutput_items;
+}
+
+} /* namespace sdrplay3 */
+} /* namespace gr */
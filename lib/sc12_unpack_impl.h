@@ -0,0 +1,35 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2024 Franco Venturi.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#ifndef INCLUDED_SDRPLAY3_SC12_UNPACK_IMPL_H
+#define INCLUDED_SDRPLAY3_SC12_UNPACK_IMPL_H
+
+#include <gnuradio/sdrplay3/sc12_unpack.h>
+
+namespace gr {
+namespace sdrplay3 {
+
+class sc12_unpack_impl : public sc12_unpack
+{
+public:
+    sc12_unpack_impl(const std::string& output_type);
+    ~sc12_unpack_impl();
+
+    int work(int noutput_items,
+             gr_vector_const_void_star& input_items,
+             gr_vector_void_star& output_items) override;
+
+private:
+    bool output_fc32;
+
+    static size_t output_size(const std::string& output_type);
+};
+
+} // namespace sdrplay3
+} // namespace gr
+
+#endif /* INCLUDED_SDRPLAY3_SC12_UNPACK_IMPL_H */
@@ -0,0 +1,107 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2024 Franco Venturi.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#ifndef INCLUDED_SDRPLAY3_SPSC_QUEUE_H
+#define INCLUDED_SDRPLAY3_SPSC_QUEUE_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace gr {
+namespace sdrplay3 {
+
+// Bounded single producer / single consumer queue, lock-free on both sides.
+// head and tail are free running counters (only written by the producer
+// and by the consumer respectively), kept on separate cache lines; each
+// producer caches the tail and reloads it only when the cached value says
+// the queue is full. The consumer reads the head once per batch, takes all
+// the items it wants and releases them with a single store.
+template <typename T>
+class spsc_queue
+{
+public:
+    spsc_queue() :
+        mask(0),
+        head(0),
+        cached_tail(0),
+        tail(0),
+        cached_head(0)
+    {
+    }
+
+    spsc_queue(const spsc_queue&) = delete;
+    void operator=(const spsc_queue&) = delete;
+
+    // (re)allocate the queue for capacity items (a power of 2) and empty it;
+    // must not be called while in use
+    void allocate(size_t capacity)
+    {
+        if (capacity != items.size()) {
+            items.assign(capacity, T());
+            mask = capacity - 1;
+        }
+        reset();
+    }
+
+    // empty the queue; must not be called while in use
+    void reset()
+    {
+        head.store(0, std::memory_order_relaxed);
+        cached_tail = 0;
+        tail.store(0, std::memory_order_relaxed);
+        cached_head = 0;
+    }
+
+    size_t capacity() const { return items.size(); }
+
+    // producer side; returns false if the queue is full
+    bool push(const T& item)
+    {
+        uint64_t h = head.load(std::memory_order_relaxed);
+        if (h - cached_tail >= items.size()) {
+            cached_tail = tail.load(std::memory_order_acquire);
+            if (h - cached_tail >= items.size())
+                return false;
+        }
+        items[h & mask] = item;
+        head.store(h + 1, std::memory_order_release);
+        return true;
+    }
+
+    // consumer side: call take(item) on the items in order until it returns
+    // false or the queue is empty, then remove the items taken
+    template <typename Take>
+    void drain(Take take)
+    {
+        uint64_t t = tail.load(std::memory_order_relaxed);
+        cached_head = head.load(std::memory_order_acquire);
+        uint64_t t0 = t;
+        while (t != cached_head && take(items[t & mask]))
+            t++;
+        if (t != t0)
+            tail.store(t, std::memory_order_release);
+    }
+
+private:
+    std::vector<T> items;
+    size_t mask;
+
+    // producer cache line
+    alignas(64) std::atomic<uint64_t> head;
+    uint64_t cached_tail;
+
+    // consumer cache line
+    alignas(64) std::atomic<uint64_t> tail;
+    uint64_t cached_head;
+};
+
+} // namespace sdrplay3
+} // namespace gr
+
+#endif /* INCLUDED_SDRPLAY3_SPSC_QUEUE_H */
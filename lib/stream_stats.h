@@ -0,0 +1,113 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2024 Franco Venturi.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#ifndef INCLUDED_SDRPLAY3_STREAM_STATS_H
+#define INCLUDED_SDRPLAY3_STREAM_STATS_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+namespace gr {
+namespace sdrplay3 {
+
+// Hot path counters and histograms for one stream.
+// Every field has a single writer (either the stream callback or work()),
+// so the updates are plain relaxed loads and stores (no locked
+// read-modify-write instructions); readers may see slightly stale values.
+class stream_stats
+{
+public:
+    // histogram of durations with power of 2 buckets in microseconds:
+    // bucket 0 is < 1us, bucket i is [2^(i-1), 2^i) us, and the last bucket
+    // also collects anything longer
+    class histogram
+    {
+    public:
+        constexpr static int NBuckets = 24;
+
+        histogram()
+        {
+            for (auto& bucket : buckets)
+                bucket.store(0, std::memory_order_relaxed);
+        }
+
+        void add(std::chrono::nanoseconds duration)
+        {
+            int64_t us = duration.count() / 1000;
+            int i = 0;
+            while (us > 0 && i < NBuckets - 1) {
+                us >>= 1;
+                i++;
+            }
+            stream_stats::add(buckets[i], 1);
+        }
+
+        uint64_t bucket(int i) const
+        {
+            return buckets[i].load(std::memory_order_relaxed);
+        }
+
+    private:
+        std::atomic<uint64_t> buckets[NBuckets];
+    };
+
+    stream_stats() :
+        callbacks(0),
+        samples(0),
+        overflow_waits(0),
+        overflow_wait_ns(0),
+        ring_fill_max(0),
+        handoff_samples(0),
+        dropped_tags(0),
+        overloads(0),
+        overload_samples(0),
+        settling_samples(0),
+        work_calls(0),
+        work_samples(0)
+    {
+    }
+
+    stream_stats(const stream_stats&) = delete;
+    void operator=(const stream_stats&) = delete;
+
+    static void add(std::atomic<uint64_t>& counter, uint64_t value)
+    {
+        counter.store(counter.load(std::memory_order_relaxed) + value,
+                      std::memory_order_relaxed);
+    }
+
+    static void max(std::atomic<uint64_t>& counter, uint64_t value)
+    {
+        if (value > counter.load(std::memory_order_relaxed))
+            counter.store(value, std::memory_order_relaxed);
+    }
+
+    // updated by the stream callback
+    alignas(64) std::atomic<uint64_t> callbacks;
+    std::atomic<uint64_t> samples;
+    std::atomic<uint64_t> overflow_waits;
+    std::atomic<uint64_t> overflow_wait_ns;
+    std::atomic<uint64_t> ring_fill_max;
+    std::atomic<uint64_t> handoff_samples;
+    std::atomic<uint64_t> dropped_tags;
+    std::atomic<uint64_t> overloads;
+    std::atomic<uint64_t> overload_samples;
+    std::atomic<uint64_t> settling_samples;
+    histogram callback_interval;
+    std::chrono::steady_clock::time_point last_callback;
+
+    // updated by work()
+    alignas(64) std::atomic<uint64_t> work_calls;
+    std::atomic<uint64_t> work_samples;
+    histogram work_time;
+};
+
+} // namespace sdrplay3
+} // namespace gr
+
+#endif /* INCLUDED_SDRPLAY3_STREAM_STATS_H */
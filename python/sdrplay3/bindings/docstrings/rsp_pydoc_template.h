@@ -81,10 +81,61 @@ static const char *__doc_gr_sdrplay3_rsp_set_agc_setpoint = R"doc()doc";
 static const char *__doc_gr_sdrplay3_rsp_set_stream_tags = R"doc()doc";
 
 
+static const char *__doc_gr_sdrplay3_rsp_set_time_tags = R"doc()doc";
+
+
+static const char *__doc_gr_sdrplay3_rsp_set_gain_tag_policy = R"doc()doc";
+
+
+static const char *__doc_gr_sdrplay3_rsp_get_clock_drift_ppm = R"doc()doc";
+
+
+static const char *__doc_gr_sdrplay3_rsp_set_overflow_policy = R"doc()doc";
+
+
+static const char *__doc_gr_sdrplay3_rsp_get_dropped_samples = R"doc()doc";
+
+
+static const char *__doc_gr_sdrplay3_rsp_set_sc8_shift = R"doc()doc";
+
+
+static const char *__doc_gr_sdrplay3_rsp_set_low_water_mark = R"doc()doc";
+
+
+static const char *__doc_gr_sdrplay3_rsp_set_max_latency = R"doc()doc";
+
+
+static const char *__doc_gr_sdrplay3_rsp_set_direct_handoff = R"doc()doc";
+
+
+static const char *__doc_gr_sdrplay3_rsp_set_settling = R"doc()doc";
+
+
+static const char *__doc_gr_sdrplay3_rsp_set_band_settling_time = R"doc()doc";
+
+
+static const char *__doc_gr_sdrplay3_rsp_get_band_settling_time = R"doc()doc";
+
+
+static const char *__doc_gr_sdrplay3_rsp_set_settling_calibration = R"doc()doc";
+
+
 static const char *__doc_gr_sdrplay3_rsp_set_debug_mode = R"doc()doc";
 
 
 static const char *__doc_gr_sdrplay3_rsp_set_sample_sequence_gaps_check = R"doc()doc";
 
 
+static const char *__doc_gr_sdrplay3_rsp_set_sample_gaps_fill = R"doc()doc";
+
+
+static const char *__doc_gr_sdrplay3_rsp_get_sample_gaps = R"doc()doc";
+
+
+static const char *__doc_gr_sdrplay3_rsp_get_stats = R"doc()doc";
+
+
+static const char *__doc_gr_sdrplay3_rsp_set_status_interval = R"doc()doc";
+
+
 static const char *__doc_gr_sdrplay3_rsp_set_show_gain_changes = R"doc()doc";
@@ -30,6 +30,7 @@ namespace py = pybind11;
     void bind_rspduo(py::module& m);
     void bind_rspdx(py::module& m);
     void bind_rspdxr2(py::module& m);
+    void bind_sc12_unpack(py::module& m);
 // ) END BINDING_FUNCTION_PROTOTYPES
 
 
@@ -67,5 +68,6 @@ PYBIND11_MODULE(sdrplay3_python, m)
     bind_rspduo(m);
     bind_rspdx(m);
     bind_rspdxr2(m);
+    bind_sc12_unpack(m);
     // ) END BINDING_FUNCTION_CALLS
 }
@@ -133,6 +133,75 @@ void bind_rsp(py::module& m)
              py::arg("enable"),
              D(rsp, set_stream_tags))
 
+        .def("set_time_tags",
+             &rsp::set_time_tags,
+             py::arg("enable"),
+             D(rsp, set_time_tags))
+
+        .def("set_gain_tag_policy",
+             &rsp::set_gain_tag_policy,
+             py::arg("policy"),
+             py::arg("value") = 0,
+             D(rsp, set_gain_tag_policy))
+
+        .def("get_clock_drift_ppm",
+             &rsp::get_clock_drift_ppm,
+             py::arg("stream_index") = 0,
+             D(rsp, get_clock_drift_ppm))
+
+        .def("set_overflow_policy",
+             &rsp::set_overflow_policy,
+             py::arg("policy"),
+             D(rsp, set_overflow_policy))
+
+        .def("get_dropped_samples",
+             &rsp::get_dropped_samples,
+             py::arg("stream_index") = 0,
+             D(rsp, get_dropped_samples))
+
+        .def("set_sc8_shift",
+             &rsp::set_sc8_shift,
+             py::arg("shift"),
+             D(rsp, set_sc8_shift))
+
+        .def("set_low_water_mark",
+             &rsp::set_low_water_mark,
+             py::arg("low_water_mark"),
+             py::arg("units") = "samples",
+             D(rsp, set_low_water_mark))
+
+        .def("set_max_latency",
+             &rsp::set_max_latency,
+             py::arg("max_latency"),
+             D(rsp, set_max_latency))
+
+        .def("set_direct_handoff",
+             &rsp::set_direct_handoff,
+             py::arg("enable"),
+             D(rsp, set_direct_handoff))
+
+        .def("set_settling",
+             &rsp::set_settling,
+             py::arg("mode"),
+             py::arg("settling_time") = -1,
+             D(rsp, set_settling))
+
+        .def("set_band_settling_time",
+             &rsp::set_band_settling_time,
+             py::arg("freq"),
+             py::arg("settling_time"),
+             D(rsp, set_band_settling_time))
+
+        .def("get_band_settling_time",
+             &rsp::get_band_settling_time,
+             py::arg("freq"),
+             D(rsp, get_band_settling_time))
+
+        .def("set_settling_calibration",
+             &rsp::set_settling_calibration,
+             py::arg("enable"),
+             D(rsp, set_settling_calibration))
+
         .def("set_debug_mode",
              &rsp::set_debug_mode,
              py::arg("enable"),
@@ -143,6 +212,25 @@ void bind_rsp(py::module& m)
              py::arg("enable"),
              D(rsp, set_sample_sequence_gaps_check))
 
+        .def("set_sample_gaps_fill",
+             &rsp::set_sample_gaps_fill,
+             py::arg("enable"),
+             D(rsp, set_sample_gaps_fill))
+
+        .def("get_sample_gaps",
+             &rsp::get_sample_gaps,
+             py::arg("stream_index") = 0,
+             D(rsp, get_sample_gaps))
+
+        .def("get_stats",
+             &rsp::get_stats,
+             D(rsp, get_stats))
+
+        .def("set_status_interval",
+             &rsp::set_status_interval,
+             py::arg("interval"),
+             D(rsp, set_status_interval))
+
         .def("set_show_gain_changes",
              &rsp::set_show_gain_changes,
              py::arg("enable"),
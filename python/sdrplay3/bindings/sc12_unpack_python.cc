@@ -0,0 +1,35 @@
+/*
+ * Copyright 2020 Free Software Foundation, Inc.
+ *
+ * This file is part of GNU Radio
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ *
+ */
+
+#include <pybind11/complex.h>
+#include <pybind11/pybind11.h>
+#include <pybind11/stl.h>
+
+namespace py = pybind11;
+
+#include <gnuradio/sdrplay3/sc12_unpack.h>
+// pydoc.h is automatically generated in the build directory
+#include <sc12_unpack_pydoc.h>
+
+void bind_sc12_unpack(py::module& m)
+{
+    using sc12_unpack = gr::sdrplay3::sc12_unpack;
+
+    py::class_<sc12_unpack,
+               gr::sync_block,
+               gr::block,
+               gr::basic_block,
+               std::shared_ptr<sc12_unpack>>(m, "sc12_unpack", D(sc12_unpack))
+
+        .def(py::init(&sc12_unpack::make),
+             py::arg("output_type") = "fc32",
+             D(sc12_unpack, make))
+
+    ;
+}
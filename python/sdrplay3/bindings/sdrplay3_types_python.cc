@@ -21,10 +21,19 @@ void bind_sdrplay3_types(py::module& m)
     using stream_args_t = gr::sdrplay3::stream_args_t;
 
     py::class_<stream_args_t>(m, "stream_args")
-        .def(py::init<const std::string&, const size_t>(),
+        .def(py::init<const std::string&, const size_t, const size_t, const bool,
+                      const bool, const size_t>(),
              py::arg("output_type") = "fc32",
-             py::arg("channels_size") = 1)
+             py::arg("channels_size") = 1,
+             py::arg("ring_buffer_size") = 65536,
+             py::arg("ring_buffer_huge_pages") = false,
+             py::arg("split_iq") = false,
+             py::arg("vector_length") = 1)
         // Properties
         .def_readwrite("output_type", &stream_args_t::output_type)
-        .def_readwrite("channels_size", &stream_args_t::channels_size);
+        .def_readwrite("channels_size", &stream_args_t::channels_size)
+        .def_readwrite("ring_buffer_size", &stream_args_t::ring_buffer_size)
+        .def_readwrite("ring_buffer_huge_pages", &stream_args_t::ring_buffer_huge_pages)
+        .def_readwrite("split_iq", &stream_args_t::split_iq)
+        .def_readwrite("vector_length", &stream_args_t::vector_length);
 }
@@ -0,0 +1,645 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2024 Franco Venturi.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+// Stand-in for the SDRplay API library (libsdrplay_api) to run and benchmark
+// gr-sdrplay3 on machines without an RSP and without the sdrplay_api service.
+// It implements the subset of the C API used by gr-sdrplay3; the devices are
+// simulated and the stream callbacks are called from a thread at the rate
+// given by the current sample rate, decimation, and IF settings, with a
+// synthetic signal (a tone plus noise, scaled by the gain reduction).
+//
+// Environment variables:
+//   SDRPLAY_API_STANDIN_DEVICES          comma separated list of simulated
+//                                        devices (rsp1, rsp1a, rsp1b, rsp2,
+//                                        rspduo, rspdx, rspdxr2); default:
+//                                        rsp1a,rsp2,rspduo,rspdx
+//   SDRPLAY_API_STANDIN_SAMPLES_PER_PKT  number of samples per packet before
+//                                        decimation; default: 1008
+
+#include <sdrplay_api.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <complex>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+constexpr unsigned int DefaultSamplesPerPkt = 1008;
+// if the streaming thread falls behind by more than this, it skips ahead
+// (the skipped samples show up as a gap in firstSampleNum)
+constexpr std::chrono::milliseconds MaxLag(100);
+constexpr double Pi = 3.14159265358979323846;
+
+struct model {
+    const char *name;
+    unsigned char hwVer;
+};
+
+const model models[] = {
+    { "rsp1", SDRPLAY_RSP1_ID },
+    { "rsp1a", SDRPLAY_RSP1A_ID },
+    { "rsp1b", SDRPLAY_RSP1B_ID },
+    { "rsp2", SDRPLAY_RSP2_ID },
+    { "rspduo", SDRPLAY_RSPduo_ID },
+    { "rspdx", SDRPLAY_RSPdx_ID },
+    { "rspdxr2", SDRPLAY_RSPdxR2_ID },
+};
+
+// settings the streaming thread works from (copied from the device
+// parameters at Init() and at every Update())
+struct active_settings {
+    double output_rate;
+    unsigned int samples_per_packet;
+    int gRdB[2];
+    int LNAstate[2];
+};
+
+struct standin_device {
+    sdrplay_api_DeviceT device;
+    bool selected;
+
+    sdrplay_api_DevParamsT dev_params;
+    sdrplay_api_RxChannelParamsT rx_channel_a;
+    sdrplay_api_RxChannelParamsT rx_channel_b;
+    sdrplay_api_DeviceParamsT device_params;
+
+    std::mutex mtx;
+    active_settings active;
+    // changed flags reported with the next packet (one per channel)
+    int fs_changed[2];
+    int rf_changed[2];
+    int gr_changed[2];
+    bool gain_change_event[2];
+
+    std::thread thread;
+    std::atomic<bool> running;
+    sdrplay_api_CallbackFnsT callback_fns;
+    void *cb_context;
+};
+
+std::mutex api_mutex;        // sdrplay_api_LockDeviceApi()
+std::mutex devices_mutex;    // list of devices
+std::vector<std::unique_ptr<standin_device>> devices;
+int open_count = 0;
+unsigned int samples_per_pkt = DefaultSamplesPerPkt;
+
+bool is_rspduo(const standin_device *dev)
+{
+    return dev->device.hwVer == SDRPLAY_RSPduo_ID;
+}
+
+bool is_dual_tuner(const standin_device *dev)
+{
+    return is_rspduo(dev) &&
+           dev->device.rspDuoMode == sdrplay_api_RspDuoMode_Dual_Tuner;
+}
+
+void create_devices()
+{
+    const char *env = std::getenv("SDRPLAY_API_STANDIN_DEVICES");
+    std::string list = env ? env : "rsp1a,rsp2,rspduo,rspdx";
+    env = std::getenv("SDRPLAY_API_STANDIN_SAMPLES_PER_PKT");
+    samples_per_pkt = env ? std::max(std::atoi(env), 1) : DefaultSamplesPerPkt;
+
+    devices.clear();
+    size_t start = 0;
+    while (start <= list.size() && devices.size() < SDRPLAY_MAX_DEVICES) {
+        size_t end = list.find(',', start);
+        if (end == std::string::npos)
+            end = list.size();
+        std::string name = list.substr(start, end - start);
+        start = end + 1;
+        auto m = std::find_if(std::begin(models), std::end(models),
+                              [&](const model& m) { return name == m.name; });
+        if (m == std::end(models))
+            continue;
+        auto dev = std::make_unique<standin_device>();
+        std::memset(&dev->device, 0, sizeof(dev->device));
+        std::snprintf(dev->device.SerNo, sizeof(dev->device.SerNo),
+                      "STANDIN%04zu", devices.size() + 1);
+        dev->device.hwVer = m->hwVer;
+        dev->device.valid = 1;
+        if (m->hwVer == SDRPLAY_RSPduo_ID) {
+            // all the modes and both tuners are available
+            dev->device.tuner = sdrplay_api_Tuner_Both;
+            dev->device.rspDuoMode = static_cast<sdrplay_api_RspDuoModeT>(
+                sdrplay_api_RspDuoMode_Single_Tuner |
+                sdrplay_api_RspDuoMode_Dual_Tuner |
+                sdrplay_api_RspDuoMode_Master);
+            dev->device.rspDuoSampleFreq = 0;
+        } else {
+            dev->device.tuner = sdrplay_api_Tuner_A;
+            dev->device.rspDuoMode = sdrplay_api_RspDuoMode_Unknown;
+        }
+        dev->device.dev = dev.get();
+        dev->selected = false;
+        dev->running = false;
+        devices.push_back(std::move(dev));
+    }
+}
+
+void default_rx_channel_params(sdrplay_api_RxChannelParamsT *rx)
+{
+    std::memset(rx, 0, sizeof(*rx));
+    rx->tunerParams.bwType = sdrplay_api_BW_0_200;
+    rx->tunerParams.ifType = sdrplay_api_IF_Zero;
+    rx->tunerParams.loMode = sdrplay_api_LO_Auto;
+    rx->tunerParams.gain.gRdB = 50;
+    rx->tunerParams.gain.LNAstate = 0;
+    rx->tunerParams.gain.minGr = sdrplay_api_NORMAL_MIN_GR_;
+    rx->tunerParams.rfFreq.rfHz = 200e6;
+    rx->tunerParams.dcOffsetTuner.dcCal = 3;
+    rx->tunerParams.dcOffsetTuner.trackTime = 1;
+    rx->tunerParams.dcOffsetTuner.refreshRateTime = 2048;
+    rx->ctrlParams.dcOffset.DCenable = 1;
+    rx->ctrlParams.dcOffset.IQenable = 1;
+    rx->ctrlParams.decimation.enable = 0;
+    rx->ctrlParams.decimation.decimationFactor = 1;
+    rx->ctrlParams.agc.enable = sdrplay_api_AGC_50HZ;
+    rx->ctrlParams.agc.setPoint_dBfs = -60;
+    rx->rsp2TunerParams.antennaSel = sdrplay_api_Rsp2_ANTENNA_A;
+    rx->rsp2TunerParams.amPortSel = sdrplay_api_Rsp2_AMPORT_2;
+    rx->rspDuoTunerParams.tuner1AmPortSel = sdrplay_api_RspDuo_AMPORT_2;
+}
+
+void default_device_params(standin_device *dev)
+{
+    std::memset(&dev->dev_params, 0, sizeof(dev->dev_params));
+    dev->dev_params.fsFreq.fsHz = 2e6;
+    if (is_rspduo(dev) && dev->device.rspDuoSampleFreq > 0)
+        dev->dev_params.fsFreq.fsHz = dev->device.rspDuoSampleFreq;
+    dev->dev_params.mode = sdrplay_api_ISOCH;
+    dev->dev_params.samplesPerPkt = samples_per_pkt;
+    dev->dev_params.rspDxParams.antennaSel = sdrplay_api_RspDx_ANTENNA_A;
+    default_rx_channel_params(&dev->rx_channel_a);
+    default_rx_channel_params(&dev->rx_channel_b);
+    if (is_dual_tuner(dev)) {
+        dev->rx_channel_a.tunerParams.ifType = sdrplay_api_IF_1_620;
+        dev->rx_channel_b.tunerParams.ifType = sdrplay_api_IF_1_620;
+    }
+    dev->device_params.devParams = &dev->dev_params;
+    dev->device_params.rxChannelA = &dev->rx_channel_a;
+    dev->device_params.rxChannelB = is_rspduo(dev) ? &dev->rx_channel_b : nullptr;
+}
+
+sdrplay_api_RxChannelParamsT *rx_channel(standin_device *dev, int channel)
+{
+    if (channel == 1 || (dev->device.tuner == sdrplay_api_Tuner_B &&
+                         !is_dual_tuner(dev))) {
+        return &dev->rx_channel_b;
+    }
+    return &dev->rx_channel_a;
+}
+
+// sample rate at the output of the IF stage and the decimator
+double output_rate(standin_device *dev)
+{
+    const auto *rx = rx_channel(dev, 0);
+    double fsHz = dev->dev_params.fsFreq.fsHz;
+    double rate;
+    switch (rx->tunerParams.ifType) {
+    case sdrplay_api_IF_1_620:
+    case sdrplay_api_IF_2_048:
+        rate = 2e6;
+        break;
+    case sdrplay_api_IF_0_450:
+        rate = fsHz / 4;
+        break;
+    default:
+        rate = fsHz;
+        break;
+    }
+    if (rx->ctrlParams.decimation.enable && rx->ctrlParams.decimation.decimationFactor > 1)
+        rate /= rx->ctrlParams.decimation.decimationFactor;
+    return rate;
+}
+
+// must be called with dev->mtx held
+void update_active_settings(standin_device *dev)
+{
+    auto& active = dev->active;
+    active.output_rate = output_rate(dev);
+    double ratio = active.output_rate / dev->dev_params.fsFreq.fsHz;
+    active.samples_per_packet = std::max(static_cast<unsigned int>(
+            std::lround(dev->dev_params.samplesPerPkt * ratio)), 1u);
+    for (int channel = 0; channel < 2; channel++) {
+        const auto *rx = rx_channel(dev, channel);
+        active.gRdB[channel] = rx->tunerParams.gain.gRdB;
+        active.LNAstate[channel] = rx->tunerParams.gain.LNAstate;
+    }
+}
+
+// simple and fast noise generator (xorshift32)
+class noise
+{
+public:
+    noise(uint32_t seed) : state(seed) {}
+
+    // uniform in [-1, 1)
+    float next()
+    {
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+        return static_cast<int32_t>(state) * (1.0f / 2147483648.0f);
+    }
+
+private:
+    uint32_t state;
+};
+
+void stream_loop(standin_device *dev)
+{
+    using std::chrono::steady_clock;
+
+    int nchannels = is_dual_tuner(dev) ? 2 : 1;
+    std::vector<short> xi[2];
+    std::vector<short> xq[2];
+    std::complex<float> phase[2] = { 1.0f, 1.0f };
+    noise noise_gen[2] = { noise(0x12345678), noise(0x9abcdef0) };
+    bool overload[2] = { false, false };
+
+    uint64_t sample_num = 0;
+    unsigned int reset = 1;
+    auto start = steady_clock::now();
+    uint64_t start_sample_num = 0;
+    double rate = 0;
+
+    while (dev->running.load(std::memory_order_acquire)) {
+        active_settings active;
+        sdrplay_api_StreamCbParamsT params[2];
+        bool gain_change_event[2];
+        {
+            std::lock_guard<std::mutex> lock(dev->mtx);
+            active = dev->active;
+            for (int channel = 0; channel < 2; channel++) {
+                params[channel].grChanged = dev->gr_changed[channel];
+                params[channel].rfChanged = dev->rf_changed[channel];
+                params[channel].fsChanged = dev->fs_changed[channel];
+                dev->gr_changed[channel] = 0;
+                dev->rf_changed[channel] = 0;
+                dev->fs_changed[channel] = 0;
+                gain_change_event[channel] = dev->gain_change_event[channel];
+                dev->gain_change_event[channel] = false;
+            }
+        }
+        if (active.output_rate != rate) {
+            rate = active.output_rate;
+            start = steady_clock::now();
+            start_sample_num = sample_num;
+        }
+
+        // pace the packets at the output sample rate
+        unsigned int num_samples = active.samples_per_packet;
+        auto due = start + std::chrono::duration_cast<steady_clock::duration>(
+                std::chrono::duration<double>((sample_num - start_sample_num) / rate));
+        auto now = steady_clock::now();
+        if (due > now) {
+            std::this_thread::sleep_until(due);
+        } else if (now - due > MaxLag) {
+            // the consumer is too slow - drop the samples like the hardware would
+            uint64_t behind = static_cast<uint64_t>(
+                std::chrono::duration<double>(now - due).count() * rate);
+            sample_num += behind;
+        }
+
+        for (int channel = 0; channel < nchannels; channel++) {
+            if (gain_change_event[channel] && dev->callback_fns.EventCbFn) {
+                sdrplay_api_EventParamsT event_params;
+                int lna_gr = 6 * active.LNAstate[channel];
+                event_params.gainParams.gRdB = active.gRdB[channel];
+                event_params.gainParams.lnaGRdB = lna_gr;
+                event_params.gainParams.currGain = 100.0 - active.gRdB[channel] - lna_gr;
+                dev->callback_fns.EventCbFn(sdrplay_api_GainChange,
+                        channel == 0 ? sdrplay_api_Tuner_A : sdrplay_api_Tuner_B,
+                        &event_params, dev->cb_context);
+            }
+
+            // tone at 1/16 of the sample rate (plus 1kHz for the second tuner)
+            // plus noise; the level follows the gain reduction
+            float amplitude = 8192.0f * std::pow(10.0f, (40.0f - active.gRdB[channel] -
+                                                         6.0f * active.LNAstate[channel]) / 20.0f);
+            float noise_amplitude = 64.0f;
+            std::complex<float> step = std::polar(1.0f,
+                    static_cast<float>(2 * Pi * (rate / 16 + channel * 1e3) / rate));
+            xi[channel].resize(num_samples);
+            xq[channel].resize(num_samples);
+            bool clipped = false;
+            for (unsigned int i = 0; i < num_samples; i++) {
+                float vi = amplitude * phase[channel].real() + noise_amplitude * noise_gen[channel].next();
+                float vq = amplitude * phase[channel].imag() + noise_amplitude * noise_gen[channel].next();
+                if (std::abs(vi) > 32767.0f || std::abs(vq) > 32767.0f) {
+                    clipped = true;
+                    vi = std::max(std::min(vi, 32767.0f), -32768.0f);
+                    vq = std::max(std::min(vq, 32767.0f), -32768.0f);
+                }
+                xi[channel][i] = static_cast<short>(vi);
+                xq[channel][i] = static_cast<short>(vq);
+                phase[channel] *= step;
+            }
+            // keep the phasor on the unit circle
+            phase[channel] /= std::abs(phase[channel]);
+
+            if (clipped != overload[channel] && dev->callback_fns.EventCbFn) {
+                overload[channel] = clipped;
+                sdrplay_api_EventParamsT event_params;
+                event_params.powerOverloadParams.powerOverloadChangeType =
+                    clipped ? sdrplay_api_Overload_Detected : sdrplay_api_Overload_Corrected;
+                dev->callback_fns.EventCbFn(sdrplay_api_PowerOverloadChange,
+                        channel == 0 ? sdrplay_api_Tuner_A : sdrplay_api_Tuner_B,
+                        &event_params, dev->cb_context);
+            }
+
+            params[channel].firstSampleNum = static_cast<unsigned int>(sample_num);
+            params[channel].numSamples = num_samples;
+        }
+
+        // in dual tuner mode both streams carry the same sample numbers
+        if (dev->callback_fns.StreamACbFn) {
+            dev->callback_fns.StreamACbFn(xi[0].data(), xq[0].data(), &params[0],
+                                          num_samples, reset, dev->cb_context);
+        }
+        if (nchannels == 2 && dev->callback_fns.StreamBCbFn) {
+            dev->callback_fns.StreamBCbFn(xi[1].data(), xq[1].data(), &params[1],
+                                          num_samples, reset, dev->cb_context);
+        }
+        reset = 0;
+        sample_num += num_samples;
+    }
+}
+
+standin_device *find_device(HANDLE dev)
+{
+    std::lock_guard<std::mutex> lock(devices_mutex);
+    for (auto& device : devices) {
+        if (device.get() == dev)
+            return device.get();
+    }
+    return nullptr;
+}
+
+} // namespace
+
+
+extern "C" {
+
+sdrplay_api_ErrT sdrplay_api_Open(void)
+{
+    std::lock_guard<std::mutex> lock(devices_mutex);
+    if (open_count++ == 0)
+        create_devices();
+    return sdrplay_api_Success;
+}
+
+sdrplay_api_ErrT sdrplay_api_Close(void)
+{
+    std::lock_guard<std::mutex> lock(devices_mutex);
+    if (open_count == 0)
+        return sdrplay_api_NotInitialised;
+    open_count--;
+    return sdrplay_api_Success;
+}
+
+sdrplay_api_ErrT sdrplay_api_ApiVersion(float *apiVer)
+{
+    if (!apiVer)
+        return sdrplay_api_InvalidParam;
+    *apiVer = SDRPLAY_API_VERSION;
+    return sdrplay_api_Success;
+}
+
+sdrplay_api_ErrT sdrplay_api_LockDeviceApi(void)
+{
+    api_mutex.lock();
+    return sdrplay_api_Success;
+}
+
+sdrplay_api_ErrT sdrplay_api_UnlockDeviceApi(void)
+{
+    api_mutex.unlock();
+    return sdrplay_api_Success;
+}
+
+sdrplay_api_ErrT sdrplay_api_GetDevices(sdrplay_api_DeviceT *devs,
+                                        unsigned int *numDevs,
+                                        unsigned int maxDevs)
+{
+    if (!devs || !numDevs)
+        return sdrplay_api_InvalidParam;
+    std::lock_guard<std::mutex> lock(devices_mutex);
+    if (open_count == 0)
+        return sdrplay_api_NotInitialised;
+    unsigned int n = 0;
+    for (auto& device : devices) {
+        if (n >= maxDevs)
+            break;
+        if (!device->selected)
+            devs[n++] = device->device;
+    }
+    *numDevs = n;
+    return sdrplay_api_Success;
+}
+
+sdrplay_api_ErrT sdrplay_api_SelectDevice(sdrplay_api_DeviceT *device)
+{
+    if (!device)
+        return sdrplay_api_InvalidParam;
+    standin_device *dev = find_device(device->dev);
+    if (!dev)
+        return sdrplay_api_InvalidParam;
+    if (dev->selected)
+        return sdrplay_api_Fail;
+    if (is_rspduo(dev)) {
+        // the caller chooses one of the available modes and tuners
+        dev->device.rspDuoMode = device->rspDuoMode;
+        dev->device.tuner = device->tuner;
+        dev->device.rspDuoSampleFreq = device->rspDuoSampleFreq;
+    }
+    dev->selected = true;
+    std::lock_guard<std::mutex> lock(dev->mtx);
+    default_device_params(dev);
+    update_active_settings(dev);
+    for (int channel = 0; channel < 2; channel++) {
+        dev->fs_changed[channel] = 0;
+        dev->rf_changed[channel] = 0;
+        dev->gr_changed[channel] = 0;
+        dev->gain_change_event[channel] = false;
+    }
+    return sdrplay_api_Success;
+}
+
+sdrplay_api_ErrT sdrplay_api_ReleaseDevice(sdrplay_api_DeviceT *device)
+{
+    if (!device)
+        return sdrplay_api_InvalidParam;
+    standin_device *dev = find_device(device->dev);
+    if (!dev)
+        return sdrplay_api_InvalidParam;
+    sdrplay_api_Uninit(dev);
+    dev->selected = false;
+    if (is_rspduo(dev)) {
+        dev->device.tuner = sdrplay_api_Tuner_Both;
+        dev->device.rspDuoMode = static_cast<sdrplay_api_RspDuoModeT>(
+            sdrplay_api_RspDuoMode_Single_Tuner |
+            sdrplay_api_RspDuoMode_Dual_Tuner |
+            sdrplay_api_RspDuoMode_Master);
+        dev->device.rspDuoSampleFreq = 0;
+    }
+    return sdrplay_api_Success;
+}
+
+const char *sdrplay_api_GetErrorString(sdrplay_api_ErrT err)
+{
+    switch (err) {
+    case sdrplay_api_Success: return "sdrplay_api_Success";
+    case sdrplay_api_Fail: return "sdrplay_api_Fail";
+    case sdrplay_api_InvalidParam: return "sdrplay_api_InvalidParam";
+    case sdrplay_api_OutOfRange: return "sdrplay_api_OutOfRange";
+    case sdrplay_api_AlreadyInitialised: return "sdrplay_api_AlreadyInitialised";
+    case sdrplay_api_NotInitialised: return "sdrplay_api_NotInitialised";
+    case sdrplay_api_NotEnabled: return "sdrplay_api_NotEnabled";
+    default: return "sdrplay_api_Fail (stand-in)";
+    }
+}
+
+sdrplay_api_ErrT sdrplay_api_DebugEnable(HANDLE dev, sdrplay_api_DbgLvl_t /*enable*/)
+{
+    return find_device(dev) ? sdrplay_api_Success : sdrplay_api_InvalidParam;
+}
+
+sdrplay_api_ErrT sdrplay_api_GetDeviceParams(HANDLE dev,
+                                             sdrplay_api_DeviceParamsT **deviceParams)
+{
+    standin_device *d = find_device(dev);
+    if (!d || !deviceParams)
+        return sdrplay_api_InvalidParam;
+    if (!d->selected)
+        return sdrplay_api_NotEnabled;
+    *deviceParams = &d->device_params;
+    return sdrplay_api_Success;
+}
+
+sdrplay_api_ErrT sdrplay_api_Init(HANDLE dev, sdrplay_api_CallbackFnsT *callbackFns,
+                                  void *cbContext)
+{
+    standin_device *d = find_device(dev);
+    if (!d || !callbackFns)
+        return sdrplay_api_InvalidParam;
+    if (!d->selected)
+        return sdrplay_api_NotEnabled;
+    if (d->running)
+        return sdrplay_api_AlreadyInitialised;
+    // like the real API, Init() copies the tuner A settings to tuner B
+    // in dual tuner mode
+    if (is_dual_tuner(d))
+        d->rx_channel_b = d->rx_channel_a;
+    {
+        std::lock_guard<std::mutex> lock(d->mtx);
+        update_active_settings(d);
+    }
+    d->callback_fns = *callbackFns;
+    d->cb_context = cbContext;
+    d->running = true;
+    d->thread = std::thread(stream_loop, d);
+    return sdrplay_api_Success;
+}
+
+sdrplay_api_ErrT sdrplay_api_Uninit(HANDLE dev)
+{
+    standin_device *d = find_device(dev);
+    if (!d)
+        return sdrplay_api_InvalidParam;
+    if (!d->running)
+        return sdrplay_api_NotInitialised;
+    d->running = false;
+    if (d->thread.joinable())
+        d->thread.join();
+    return sdrplay_api_Success;
+}
+
+sdrplay_api_ErrT sdrplay_api_Update(HANDLE dev, sdrplay_api_TunerSelectT tuner,
+                                    sdrplay_api_ReasonForUpdateT reasonForUpdate,
+                                    sdrplay_api_ReasonForUpdateExtension1T /*reasonForUpdateExt1*/)
+{
+    standin_device *d = find_device(dev);
+    if (!d)
+        return sdrplay_api_InvalidParam;
+    if (!d->running)
+        return sdrplay_api_NotInitialised;
+
+    // stream channel(s) affected by the update
+    bool channels[2];
+    if (is_dual_tuner(d)) {
+        channels[0] = tuner & sdrplay_api_Tuner_A;
+        channels[1] = tuner & sdrplay_api_Tuner_B;
+    } else {
+        channels[0] = true;
+        channels[1] = false;
+    }
+
+    std::lock_guard<std::mutex> lock(d->mtx);
+    if (reasonForUpdate & sdrplay_api_Update_Dev_ResetFlags) {
+        const auto& reset_flags = d->dev_params.resetFlags;
+        for (int channel = 0; channel < 2; channel++) {
+            if (reset_flags.resetGainUpdate)
+                d->gr_changed[channel] = 0;
+            if (reset_flags.resetRfUpdate)
+                d->rf_changed[channel] = 0;
+            if (reset_flags.resetFsUpdate)
+                d->fs_changed[channel] = 0;
+        }
+    }
+    update_active_settings(d);
+    for (int channel = 0; channel < 2; channel++) {
+        if (reasonForUpdate & (sdrplay_api_Update_Dev_Fs |
+                               sdrplay_api_Update_Ctrl_Decimation |
+                               sdrplay_api_Update_Tuner_IfType)) {
+            // the sample rate is common to both tuners
+            d->fs_changed[channel] = 1;
+        }
+        if (!channels[channel])
+            continue;
+        if (reasonForUpdate & sdrplay_api_Update_Tuner_Frf)
+            d->rf_changed[channel] = 1;
+        if (reasonForUpdate & sdrplay_api_Update_Tuner_Gr) {
+            d->gr_changed[channel] = 1;
+            d->gain_change_event[channel] = true;
+        }
+    }
+    return sdrplay_api_Success;
+}
+
+sdrplay_api_ErrT sdrplay_api_SwapRspDuoActiveTuner(HANDLE dev,
+                                                   sdrplay_api_TunerSelectT *currentTuner,
+                                                   sdrplay_api_RspDuo_AmPortSelectT tuner1AmPortSel)
+{
+    standin_device *d = find_device(dev);
+    if (!d || !currentTuner)
+        return sdrplay_api_InvalidParam;
+    if (!is_rspduo(d) || d->device.rspDuoMode != sdrplay_api_RspDuoMode_Single_Tuner)
+        return sdrplay_api_InvalidMode;
+    std::lock_guard<std::mutex> lock(d->mtx);
+    d->device.tuner = d->device.tuner == sdrplay_api_Tuner_B ? sdrplay_api_Tuner_A :
+                                                                 sdrplay_api_Tuner_B;
+    rx_channel(d, 0)->rspDuoTunerParams.tuner1AmPortSel = tuner1AmPortSel;
+    *currentTuner = d->device.tuner;
+    update_active_settings(d);
+    d->rf_changed[0] = 1;
+    return sdrplay_api_Success;
+}
+
+} // extern "C"